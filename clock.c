@@ -7,6 +7,9 @@
  * Old time stamp could removed, since time stamp counter no longer tracks clock cycles
  * (C) R. E. Bryant, 2016
  *
+ * The time stamp counter is back as an optional timer backend: on an
+ * invariant TSC it ticks at a constant rate, so once calibrated against
+ * clock_gettime it gives sub-nanosecond timing without a system call.
  */
 
 /* If defined, will use clock_gettime, rather than gettimeofday */
@@ -14,6 +17,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
 #ifdef USE_TOD
 #include <sys/time.h>
 #else
@@ -25,10 +31,19 @@ int gverbose = 1;
 
 /* Timer granularity */
 #ifdef USE_TOD
-const double timer_resolution = 1e-6;
+#define CLOCK_RESOLUTION 1e-6
 #else
-const double timer_resolution = 1e-9;
+#define CLOCK_RESOLUTION 1e-9
 #endif
+double timer_resolution = CLOCK_RESOLUTION;
+
+/* TSC backend state */
+#define TSC_CALIBRATE_NS 20000000 /* length of one calibration run */
+#define TSC_TOLERANCE 0.001       /* allowed disagreement between runs */
+static int use_tsc = 0;           /* time start/get_timer with the TSC? */
+static int tsc_state = 0;         /* 0 unknown, 1 usable, -1 unusable */
+static double tsc_ns = 0.0;       /* nanoseconds per TSC tick */
+static uint64_t last_tsc;
 
 /* Keep track of clock speed */
 double cpu_mhz = 0.0;
@@ -88,6 +103,10 @@ struct timespec new_time;
 void start_timer()
 {
     int rval;
+    if (use_tsc) {
+        last_tsc = ticks_begin();
+        return;
+    }
 #ifdef USE_TOD
     rval = gettimeofday(&last_time, NULL);
 #else
@@ -103,6 +122,8 @@ double get_timer()
 {
     int rval;
     double delta_secs = 0.0;
+    if (use_tsc)
+        return (double) (ticks_end() - last_tsc) * tsc_ns * 1e-9;
 #ifdef USE_TOD
     rval = gettimeofday(&new_time, NULL);
 #else
@@ -141,3 +162,95 @@ double get_counter()
     return delta_secs * cpu_mhz * 1e6;
 }
 
+#if defined(__x86_64__) || defined(__i386__)
+
+/* Does the kernel itself trust the TSC as its clocksource?  Hypervisors
+   often hide the invariant-TSC flag even when the TSC is fine */
+static int kernel_uses_tsc()
+{
+    char buf[MAXBUF] = "";
+    FILE *fp = fopen("/sys/devices/system/clocksource/clocksource0/"
+                     "current_clocksource", "r");
+    if (!fp)
+        return 0;
+    if (!fgets(buf, MAXBUF, fp))
+        buf[0] = '\0';
+    fclose(fp);
+    return strncmp(buf, "tsc", 3) == 0;
+}
+
+/* Is there a TSC that ticks at a constant rate, and RDTSCP to read it? */
+static int tsc_invariant()
+{
+    /* EDX bits: TSC in leaf 1, RDTSCP in 0x80000001, and
+       invariant TSC in 0x80000007 */
+    unsigned int a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d) || !(d & (1u << 4)))
+        return 0;
+    if (!__get_cpuid(0x80000001, &a, &b, &c, &d) || !(d & (1u << 27)))
+        return 0;
+    if (__get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1u << 8)))
+        return 1;
+    return kernel_uses_tsc();
+}
+
+static uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Nanoseconds per TSC tick, measured over TSC_CALIBRATE_NS */
+static double calibrate_tsc()
+{
+    uint64_t t0, t1, c0, c1;
+    t0 = monotonic_ns();
+    c0 = ticks_begin();
+    do {
+        t1 = monotonic_ns();
+    } while (t1 - t0 < TSC_CALIBRATE_NS);
+    c1 = ticks_end();
+    t1 = monotonic_ns();
+    if (c1 <= c0)
+        return 0.0;
+    return (double) (t1 - t0) / (double) (c1 - c0);
+}
+
+double ticks_ns()
+{
+    if (tsc_state == 0) {
+        tsc_state = -1;
+        if (tsc_invariant()) {
+            /* Two runs must agree, or the TSC rate is not constant */
+            double a = calibrate_tsc();
+            double b = calibrate_tsc();
+            double diff = a > b ? a - b : b - a;
+            if (a > 0.0 && b > 0.0 && diff <= TSC_TOLERANCE * a) {
+                tsc_ns = (a + b) / 2;
+                tsc_state = 1;
+            }
+        }
+    }
+    return tsc_ns;
+}
+
+#else /* no TSC */
+
+double ticks_ns()
+{
+    return 1.0; /* ticks_begin/ticks_end read a nanosecond clock */
+}
+
+#endif
+
+int use_tsc_timer(int enable)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    use_tsc = enable && ticks_ns() > 0.0;
+#else
+    use_tsc = 0;
+#endif
+    timer_resolution = use_tsc ? tsc_ns * 1e-9 : CLOCK_RESOLUTION;
+    return use_tsc;
+}
@@ -1,7 +1,16 @@
+#ifndef __CLOCK_H_
+#define __CLOCK_H_
+
 /* Routines for timing functions */
 
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
 /*  minimum resolution of timer (secs) */
-extern const double timer_resolution;
+extern double timer_resolution;
 
 /* Timer: measures in seconds */
 
@@ -11,6 +20,18 @@ void start_timer();
 /* Get # seconds since timer started.  Returns 1e20 if detect timing anomaly */
 double get_timer();
 
+/* Time the timer with the calibrated time stamp counter (enable = 1) or
+   the thread CPU-time clock (enable = 0).  The TSC counts wall time, so
+   it includes time the thread spends descheduled.  Falls back to the
+   clock, and returns 0, if the TSC is missing, not invariant, or does
+   not calibrate consistently; returns 1 if the TSC is in use.  Call
+   before the first measurement: fcyc fixes its minimum time then. */
+int use_tsc_timer(int enable);
+
+/* Nanoseconds per tick of ticks_begin/ticks_end, or 0 if the ticks
+   have no known relation to time (a TSC that failed the checks) */
+double ticks_ns();
+
 /* Determine clock rate of processor (using a default sleeptime) */
 double mhz(int verbose);
 
@@ -20,3 +41,39 @@ void start_counter();
 
 /* Get # cycles since counter started.  Returns 1e20 if detect timing anomaly */
 double get_counter();
+
+/*
+ * Timestamps for timing a short stretch of code, such as a single
+ * allocator call: subtract ticks_begin() from ticks_end().  On x86
+ * these read the time stamp counter, fenced so the timed code can
+ * neither start before the first read nor finish after the second;
+ * elsewhere they read a nanosecond clock.
+ */
+static inline uint64_t ticks_begin(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t t;
+    _mm_lfence();
+    t = __rdtsc();
+    _mm_lfence();
+    return t;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline uint64_t ticks_end(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int aux;
+    uint64_t t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+#else
+    return ticks_begin();
+#endif
+}
+
+#endif /* __CLOCK_H_ */
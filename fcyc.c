@@ -1,7 +1,13 @@
 /* Compute time used by function f */
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <sys/times.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 #include "clock.h"
 #include "fcyc.h"
@@ -14,6 +20,9 @@
 #define CACHE_BLOCK 32
 #define MIN_TICKS 1000
 #define MIN_REPS 8
+#define WARMUP 0
+#define MIN_SAMPLES 0
+#define BOOTSTRAP 1000
 
 static long int kbest = K;
 static int clear_cache = CLEAR_CACHE;
@@ -24,18 +33,21 @@ static long int cache_block = CACHE_BLOCK;
 static long int min_reps = MIN_REPS;
 static long int min_ticks = MIN_TICKS;
 static double min_time = 0;
+static long int warmup = WARMUP;
+static long int min_samples = MIN_SAMPLES;
+static long int bootstrap = BOOTSTRAP;
 
 static long int *cache_buf = NULL;
+static void (*clear_funct)(void *) = NULL;
+static void *clear_arg = NULL;
 
 static double *values = NULL;
 static long int samplecount = 0;
 
 #define KEEP_VALS 0
-#define KEEP_SAMPLES 0
 
-#if KEEP_SAMPLES
+/* Every sample of the current measurement, for the robust statistics */
 static double *samples = NULL;
-#endif
 
 /* Initialize the minimum time threshold */
 static void init_min_time() {
@@ -49,12 +61,15 @@ static void init_sampler()
     if (values)
         free(values);
     values = calloc(kbest, sizeof(double));
-#if KEEP_SAMPLES
     if (samples)
         free(samples);
     /* Allocate extra for wraparound analysis */
-    samples = calloc(maxsamples+kbest, sizeof(double));
-#endif
+    samples = calloc((maxsamples > min_samples ? maxsamples : min_samples) + kbest,
+                     sizeof(double));
+    if (!values || !samples) {
+        fprintf(stderr, "Fatal error.  Malloc returned null in init_sampler\n");
+        exit(1);
+    }
     samplecount = 0;
 }
 
@@ -69,9 +84,7 @@ static void add_sample(double val)
         pos = kbest-1;
         values[pos] = val;
     }
-#if KEEP_SAMPLES
     samples[samplecount] = val;
-#endif
     samplecount++;
     /* Insertion sort */
     while (pos > 0 && values[pos-1] > values[pos]) {
@@ -90,6 +103,76 @@ static long int has_converged()
         ((1 + epsilon)*values[0] >= values[kbest-1]);
 }
 
+/* Keep sampling until K-best converges, or we give up.  In robust
+   mode, take at least min_samples regardless */
+static long int need_more_samples()
+{
+    if (samplecount < min_samples)
+        return 1;
+    return !has_converged() && samplecount < maxsamples;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Median of n values, sorting them in place */
+static double median(double *v, long int n)
+{
+    qsort(v, n, sizeof(double), compare_doubles);
+    return n % 2 ? v[n/2] : (v[n/2-1] + v[n/2]) / 2;
+}
+
+/* Private generator for the bootstrap, so measuring does not perturb
+   the caller's random() sequence */
+static uint64_t boot_state = 0x2545F4914F6CDD1DULL;
+
+static uint64_t boot_next()
+{
+    boot_state ^= boot_state << 13;
+    boot_state ^= boot_state >> 7;
+    boot_state ^= boot_state << 17;
+    return boot_state;
+}
+
+/* Fill stats from the samples of the measurement just taken: median,
+   and a percentile bootstrap 95% confidence interval of the median */
+static void summarize(fcyc_stats_t *stats)
+{
+    long int n = samplecount, b, i;
+    double *sorted = malloc(n * sizeof(double));
+    double *resample = malloc(n * sizeof(double));
+    double *medians = malloc(bootstrap * sizeof(double));
+
+    if (!sorted || !resample || !medians) {
+        fprintf(stderr, "Fatal error.  Malloc returned null in summarize\n");
+        exit(1);
+    }
+    stats->best = values[0];
+    stats->nsamples = n;
+    stats->converged = has_converged();
+    stats->samples = samples;
+    memcpy(sorted, samples, n * sizeof(double));
+    stats->median = median(sorted, n);
+    for (b = 0; b < bootstrap; b++) {
+        for (i = 0; i < n; i++)
+            resample[i] = samples[boot_next() % n];
+        medians[b] = median(resample, n);
+    }
+    if (bootstrap > 0) {
+        qsort(medians, bootstrap, sizeof(double), compare_doubles);
+        stats->ci_lo = medians[(long int) (0.025 * (bootstrap - 1))];
+        stats->ci_hi = medians[(long int) (0.975 * (bootstrap - 1))];
+    } else {
+        stats->ci_lo = stats->ci_hi = stats->median;
+    }
+    free(sorted);
+    free(resample);
+    free(medians);
+}
+
 /* Code to clear cache */
 
 
@@ -116,6 +199,40 @@ static void clear()
     sink = x;
 }
 
+/* Clear the cache, by the caller's routine if one was set */
+static void do_clear()
+{
+    if (clear_funct)
+        clear_funct(clear_arg);
+    else
+        clear();
+}
+
+/* Seconds taken by reps calls of f.  When clearing before every rep,
+   only the calls themselves are timed */
+static double time_reps(test_funct f, void *args, long reps)
+{
+    long r;
+    double sec = 0.0;
+
+    if (clear_cache == FCYC_CLEAR_EACH_REP) {
+        for (r = 0; r < reps; r++) {
+            do_clear();
+            start_timer();
+            f(args);
+            sec += get_timer();
+        }
+        return sec;
+    }
+    if (clear_cache)
+        do_clear();
+    start_timer();
+    for (r = 0; r < reps; r++) {
+        f(args);
+    }
+    return get_timer();
+}
+
 double fcyc(test_funct f, void *args)
 {
     double result;
@@ -125,9 +242,11 @@ double fcyc(test_funct f, void *args)
     /* Increase reps until get meaningful times */
     double sec = 0.0;
     init_min_time();
+    for (r = 0; r < warmup; r++)
+        f(args);
     while (sec < min_time) {
         if (clear_cache)
-            clear();
+            do_clear();
         start_timer();
         for (r = 0; r < reps; r++) {
             f(args);
@@ -139,7 +258,7 @@ double fcyc(test_funct f, void *args)
     init_sampler();
     do {
         if (clear_cache)
-            clear();
+            do_clear();
         start_counter();
         for (r = 0; r < reps; r++) {
             f(args);
@@ -147,7 +266,7 @@ double fcyc(test_funct f, void *args)
         cyc = (double) get_counter() / reps;
         if (cyc > 0.0)
             add_sample(cyc);
-    } while (!has_converged() && samplecount < maxsamples);
+    } while (need_more_samples());
     result = values[0];
 #if !KEEP_VALS
     free(values); 
@@ -157,6 +276,11 @@ double fcyc(test_funct f, void *args)
 }
 
 double fsec(test_funct f, void *args)
+{
+    return fsec_stats(f, args, NULL);
+}
+
+double fsec_stats(test_funct f, void *args, fcyc_stats_t *stats)
 {
     double result;
     /* Increase reps until get meaningful times */
@@ -164,14 +288,10 @@ double fsec(test_funct f, void *args)
     long r;
     double sec = 0.0;
     init_min_time();
+    for (r = 0; r < warmup; r++)
+        f(args);
     while (sec < min_time) {
-        if (clear_cache)
-            clear();
-        start_timer();
-        for (r = 0; r < reps; r++) {
-            f(args);
-        }
-        sec = get_timer();
+        sec = time_reps(f, args, reps);
         if (sec < min_time)
             reps += reps;
         //        printf("uSecs = %.3f, reps = %ld\n", sec * 1e6, reps);
@@ -179,18 +299,14 @@ double fsec(test_funct f, void *args)
     init_sampler();
     //    printf("\nuSecs (reps=%ld):", reps);
     do {
-        if (clear_cache)
-            clear();
-        start_timer();
-        for (r = 0; r < reps; r++) {
-            f(args);
-        }
-        sec = get_timer()/reps;
+        sec = time_reps(f, args, reps)/reps;
         //        printf(" %.3f", sec * 1e6);
         if (sec > 0.0)
             add_sample(sec);
-    } while (!has_converged() && samplecount < maxsamples);
+    } while (need_more_samples());
     result = values[0];
+    if (stats)
+        summarize(stats);
     //    printf(" --> %.3f\n", result * 1e6);
 #if !KEEP_VALS
     free(values); 
@@ -214,7 +330,8 @@ void set_fcyc_min_reps(int r) {
     min_reps = r;
 }
 
-/* When set, will run code to clear cache before each measurement 
+/* When set, will run code to clear cache before each measurement,
+   or (FCYC_CLEAR_EACH_REP, fsec only) before every call of the function
    Default = 0
 */
 void set_fcyc_clear_cache(int clear)
@@ -268,7 +385,113 @@ void set_fcyc_epsilon(double epsilon_arg)
     epsilon = epsilon_arg;
 }
 
+/* Number of untimed calls of f before measuring
+   Default = 0
+*/
+void set_fcyc_warmup(long int runs)
+{
+    warmup = runs;
+}
 
+/* Minimum number of samples to take even once K-best has converged;
+   nonzero selects robust mode
+   Default = 0
+*/
+void set_fcyc_min_samples(long int n)
+{
+    min_samples = n;
+}
 
+/* Number of bootstrap resamples for the confidence interval
+   Default = 1000
+*/
+void set_fcyc_bootstrap(long int resamples)
+{
+    bootstrap = resamples;
+}
 
+/* Pin the calling process to CPU cpu, so samples are not spread over
+   cores with different cache state or clock speed.  Returns 0 on
+   success, -1 if the CPU could not be used
+*/
+int fcyc_pin_cpu(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return -1;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    return -1;
+#endif
+}
 
+/* Clear the cache by calling fn(arg) instead of sweeping a buffer;
+   NULL restores the sweep
+*/
+void set_fcyc_clear_funct(void (*fn)(void *), void *arg)
+{
+    clear_funct = fn;
+    clear_arg = arg;
+}
+
+/* Read a size such as "32768K" from a sysfs cache attribute */
+static long int read_cache_attr(int index, const char *attr)
+{
+    char path[128], buf[64];
+    char unit = 0;
+    long int val = 0;
+    FILE *fp;
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu0/cache/index%d/%s", index, attr);
+    if ((fp = fopen(path, "r")) == NULL)
+        return -1;
+    if (fgets(buf, sizeof(buf), fp) == NULL ||
+        sscanf(buf, "%ld%c", &val, &unit) < 1)
+        val = -1;
+    fclose(fp);
+    if (unit == 'K')
+        val <<= 10;
+    else if (unit == 'M')
+        val <<= 20;
+    return val;
+}
+
+/* Size and line size of the last-level (highest level, data or
+   unified) cache as reported by sysfs.  Returns 0 if unknown
+*/
+long int fcyc_llc_bytes(long int *line_bytes)
+{
+    long int best_level = 0, bytes = 0, line = 0;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        char path[128], type[32] = "";
+        long int level = read_cache_attr(i, "level");
+        FILE *fp;
+
+        if (level < 0)
+            break;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+        if ((fp = fopen(path, "r")) != NULL) {
+            if (fgets(type, sizeof(type), fp) == NULL)
+                type[0] = '\0';
+            fclose(fp);
+        }
+        if (strncmp(type, "Instruction", 11) == 0 || level < best_level)
+            continue;
+        best_level = level;
+        bytes = read_cache_attr(i, "size");
+        line = read_cache_attr(i, "coherency_line_size");
+    }
+    if (bytes < 0)
+        bytes = 0;
+    if (line_bytes)
+        *line_bytes = line > 0 ? line : 0;
+    return bytes;
+}
@@ -7,13 +7,26 @@
 
 typedef void (*test_funct)(void *);
 
+/* What a measurement looked like, beyond the K-best answer */
+typedef struct {
+    double best;          /* K-best value, as returned */
+    double median;        /* median of all samples */
+    double ci_lo, ci_hi;  /* bootstrap 95% confidence interval of the median */
+    long int nsamples;    /* number of samples taken */
+    int converged;        /* did the K best samples agree within epsilon? */
+    const double *samples; /* all samples, valid until the next measurement */
+} fcyc_stats_t;
+
 /* Compute number of cycles used by function f on given set of parameters */
 double fcyc(test_funct f, void* args);
 
 
-/* Compute number of cycles used by function f on given set of parameters */
+/* Compute number of seconds used by function f on given set of parameters */
 double fsec(test_funct f, void* args);
 
+/* Like fsec, and also describe the samples in stats (if not NULL) */
+double fsec_stats(test_funct f, void* args, fcyc_stats_t *stats);
+
 /***********************************************************/
 /* Set the various parameters used by measurement routines */
 
@@ -23,11 +36,24 @@ void set_fcyc_min_ticks(int t);
 /* Sets minimum number of repetitions of function.  Default = 8 */
 void set_fcyc_min_reps(int r);
 
-/* When set, will run code to clear cache before each measurement 
+/* When set, will run code to clear cache before each measurement,
+   or, with FCYC_CLEAR_EACH_REP, before every call of the function
+   (fsec only; the clearing itself is not timed)
    Default = 0
 */
+#define FCYC_CLEAR_EACH_REP 2
 void set_fcyc_clear_cache(int clear);
 
+/* Clear the cache by calling fn(arg) rather than by sweeping a buffer
+   of the cache size.  NULL restores the sweep
+*/
+void set_fcyc_clear_funct(void (*fn)(void *), void *arg);
+
+/* Size in bytes of the last-level cache according to sysfs, or 0 if
+   unknown.  Its line size is stored in *line_bytes, if not NULL
+*/
+long int fcyc_llc_bytes(long int *line_bytes);
+
 /* Set size of cache to use when clearing cache 
    Default = 1<<19 (512KB)
 */
@@ -59,5 +85,24 @@ void set_fcyc_maxsamples(long int maxsamples);
 */
 void set_fcyc_epsilon(double epsilon);
 
+/* Number of untimed calls of the function before measuring
+   Default = 0
+*/
+void set_fcyc_warmup(long int runs);
+
+/* Robust mode: take at least this many samples even after K-best has
+   converged, so the median and its confidence interval mean something
+   Default = 0 (off)
+*/
+void set_fcyc_min_samples(long int n);
+
+/* Number of bootstrap resamples for the confidence interval
+   Default = 1000
+*/
+void set_fcyc_bootstrap(long int resamples);
+
+/* Pin the calling process to one CPU.  Returns 0 on success, else -1 */
+int fcyc_pin_cpu(int cpu);
+
 
 
@@ -0,0 +1,52 @@
+/*
+ * hist.c - Log-linear (HDR-style) latency histograms
+ */
+#include <string.h>
+#include <math.h>
+
+#include "hist.h"
+
+/* Highest value that maps to bucket idx */
+static uint64_t bucket_high(int idx)
+{
+    if (idx < 2 * HIST_SUB_COUNT)
+        return (uint64_t) idx;
+    int shift = idx / HIST_SUB_COUNT - 1;
+    uint64_t mant = (uint64_t) (idx - shift * HIST_SUB_COUNT);
+    return ((mant + 1) << shift) - 1;
+}
+
+void hist_reset(hist_t *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+uint64_t hist_percentile(const hist_t *h, double pct)
+{
+    uint64_t target, seen = 0;
+    int i;
+
+    if (h->count == 0)
+        return 0;
+    target = (uint64_t) ceil(pct / 100.0 * (double) h->count);
+    if (target == 0)
+        target = 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            uint64_t val = bucket_high(i);
+            return val < h->max ? val : h->max;
+        }
+    }
+    return h->max;
+}
+
+void hist_merge(hist_t *dst, const hist_t *src)
+{
+    int i;
+    for (i = 0; i < HIST_BUCKETS; i++)
+        dst->counts[i] += src->counts[i];
+    dst->count += src->count;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
@@ -0,0 +1,52 @@
+#ifndef __HIST_H_
+#define __HIST_H_
+
+/*
+ * hist.h - Log-linear (HDR-style) latency histograms
+ *
+ * Values below 2*HIST_SUB_COUNT are recorded exactly.  Above that,
+ * every power-of-two range is split into HIST_SUB_COUNT linear
+ * sub-buckets, so the relative error of a reported percentile is
+ * bounded by 1/HIST_SUB_COUNT (about 3%) over the full 64-bit range.
+ */
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t count;                 /* number of recorded values */
+    uint64_t max;                   /* largest recorded value */
+    uint64_t counts[HIST_BUCKETS];  /* per-bucket value counts */
+} hist_t;
+
+/* Clear all recorded values */
+void hist_reset(hist_t *h);
+
+/* Return the value at percentile pct (0 < pct <= 100) */
+uint64_t hist_percentile(const hist_t *h, double pct);
+
+/* Add all values recorded in src to dst */
+void hist_merge(hist_t *dst, const hist_t *src);
+
+/* Map a value to its bucket */
+static inline int hist_bucket(uint64_t val)
+{
+    if (val < 2 * HIST_SUB_COUNT)
+        return (int) val;
+    int shift = 63 - __builtin_clzll(val) - HIST_SUB_BITS;
+    return shift * HIST_SUB_COUNT + (int) (val >> shift);
+}
+
+/* Record one value */
+static inline void hist_record(hist_t *h, uint64_t val)
+{
+    h->counts[hist_bucket(val)]++;
+    h->count++;
+    if (val > h->max)
+        h->max = val;
+}
+
+#endif /* __HIST_H_ */
@@ -0,0 +1,312 @@
+/*
+ * json.c - Minimal JSON reader and writer helpers
+ *
+ * Recursive descent over a buffer holding the whole file.  \u escapes
+ * outside ASCII are replaced by '?', which is fine for the file names
+ * and metadata the driver writes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "json.h"
+
+typedef struct {
+    const char *pos;
+    const char *err;
+} parser_t;
+
+static json_value_t *parse_value(parser_t *p);
+
+static void skip_ws(parser_t *p)
+{
+    while (isspace((unsigned char) *p->pos))
+        p->pos++;
+}
+
+static json_value_t *new_value(json_type_t type)
+{
+    json_value_t *v = calloc(1, sizeof(json_value_t));
+    if (v == NULL) {
+        fprintf(stderr, "Fatal error.  Out of memory parsing JSON\n");
+        exit(1);
+    }
+    v->type = type;
+    return v;
+}
+
+/* Append a child (and, for objects, its key) to an array or object */
+static void add_child(json_value_t *v, char *key, json_value_t *child)
+{
+    v->items = realloc(v->items, (v->count + 1) * sizeof(json_value_t *));
+    if (v->type == JSON_OBJECT)
+        v->keys = realloc(v->keys, (v->count + 1) * sizeof(char *));
+    if (v->items == NULL || (v->type == JSON_OBJECT && v->keys == NULL)) {
+        fprintf(stderr, "Fatal error.  Out of memory parsing JSON\n");
+        exit(1);
+    }
+    v->items[v->count] = child;
+    if (v->type == JSON_OBJECT)
+        v->keys[v->count] = key;
+    v->count++;
+}
+
+static char *parse_string(parser_t *p)
+{
+    size_t len = 0, cap = 16;
+    char *buf = malloc(cap);
+
+    p->pos++; /* opening quote */
+    while (*p->pos != '"') {
+        char c = *p->pos++;
+        if (c == '\0') {
+            p->err = "unterminated string";
+            free(buf);
+            return NULL;
+        }
+        if (c == '\\') {
+            c = *p->pos++;
+            switch (c) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'u': {
+                unsigned code = 0;
+                if (sscanf(p->pos, "%4x", &code) != 1) {
+                    p->err = "bad \\u escape";
+                    free(buf);
+                    return NULL;
+                }
+                p->pos += 4;
+                c = code < 0x80 ? (char) code : '?';
+                break;
+            }
+            case '\0':
+                p->err = "unterminated string";
+                free(buf);
+                return NULL;
+            default:
+                break; /* \" \\ \/ */
+            }
+        }
+        if (len + 1 >= cap)
+            buf = realloc(buf, cap *= 2);
+        buf[len++] = c;
+    }
+    p->pos++; /* closing quote */
+    buf[len] = '\0';
+    return buf;
+}
+
+static json_value_t *parse_container(parser_t *p, json_type_t type)
+{
+    char close = type == JSON_OBJECT ? '}' : ']';
+    json_value_t *v = new_value(type);
+
+    p->pos++;
+    skip_ws(p);
+    if (*p->pos == close) {
+        p->pos++;
+        return v;
+    }
+    for (;;) {
+        char *key = NULL;
+        json_value_t *child;
+
+        skip_ws(p);
+        if (type == JSON_OBJECT) {
+            if (*p->pos != '"') {
+                p->err = "expected member name";
+                break;
+            }
+            if ((key = parse_string(p)) == NULL)
+                break;
+            skip_ws(p);
+            if (*p->pos != ':') {
+                p->err = "expected ':'";
+                free(key);
+                break;
+            }
+            p->pos++;
+        }
+        if ((child = parse_value(p)) == NULL) {
+            free(key);
+            break;
+        }
+        add_child(v, key, child);
+        skip_ws(p);
+        if (*p->pos == ',') {
+            p->pos++;
+            continue;
+        }
+        if (*p->pos == close) {
+            p->pos++;
+            return v;
+        }
+        p->err = type == JSON_OBJECT ? "expected ',' or '}'" : "expected ',' or ']'";
+        break;
+    }
+    json_free(v);
+    return NULL;
+}
+
+static json_value_t *parse_value(parser_t *p)
+{
+    json_value_t *v;
+    char *end;
+
+    skip_ws(p);
+    switch (*p->pos) {
+    case '{':
+        return parse_container(p, JSON_OBJECT);
+    case '[':
+        return parse_container(p, JSON_ARRAY);
+    case '"':
+        v = new_value(JSON_STRING);
+        if ((v->string = parse_string(p)) == NULL) {
+            free(v);
+            return NULL;
+        }
+        return v;
+    case 't':
+    case 'f':
+    case 'n':
+        if (strncmp(p->pos, "true", 4) == 0) {
+            v = new_value(JSON_BOOL);
+            v->number = 1;
+            p->pos += 4;
+        } else if (strncmp(p->pos, "false", 5) == 0) {
+            v = new_value(JSON_BOOL);
+            p->pos += 5;
+        } else if (strncmp(p->pos, "null", 4) == 0) {
+            v = new_value(JSON_NULL);
+            p->pos += 4;
+        } else {
+            p->err = "unexpected literal";
+            return NULL;
+        }
+        return v;
+    default:
+        v = new_value(JSON_NUMBER);
+        v->number = strtod(p->pos, &end);
+        if (end == p->pos) {
+            p->err = "unexpected character";
+            free(v);
+            return NULL;
+        }
+        p->pos = end;
+        return v;
+    }
+}
+
+json_value_t *json_parse_file(const char *path, char *err, size_t errlen)
+{
+    FILE *fp;
+    char *buf;
+    long len;
+    parser_t p;
+    json_value_t *v;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        snprintf(err, errlen, "could not open %s", path);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (len < 0 || (buf = malloc(len + 1)) == NULL) {
+        fclose(fp);
+        snprintf(err, errlen, "could not read %s", path);
+        return NULL;
+    }
+    len = (long) fread(buf, 1, len, fp);
+    buf[len] = '\0';
+    fclose(fp);
+
+    p.pos = buf;
+    p.err = NULL;
+    v = parse_value(&p);
+    if (v != NULL) {
+        skip_ws(&p);
+        if (*p.pos != '\0') {
+            p.err = "trailing characters";
+            json_free(v);
+            v = NULL;
+        }
+    }
+    if (v == NULL)
+        snprintf(err, errlen, "%s: %s at offset %ld", path,
+                 p.err ? p.err : "parse error", (long) (p.pos - buf));
+    free(buf);
+    return v;
+}
+
+void json_free(json_value_t *v)
+{
+    int i;
+    if (v == NULL)
+        return;
+    for (i = 0; i < v->count; i++) {
+        json_free(v->items[i]);
+        if (v->keys)
+            free(v->keys[i]);
+    }
+    free(v->items);
+    free(v->keys);
+    free(v->string);
+    free(v);
+}
+
+json_value_t *json_get(const json_value_t *v, const char *key)
+{
+    int i;
+    if (v == NULL || v->type != JSON_OBJECT)
+        return NULL;
+    for (i = 0; i < v->count; i++)
+        if (strcmp(v->keys[i], key) == 0)
+            return v->items[i];
+    return NULL;
+}
+
+json_value_t *json_at(const json_value_t *v, int i)
+{
+    if (v == NULL || v->type != JSON_ARRAY || i < 0 || i >= v->count)
+        return NULL;
+    return v->items[i];
+}
+
+double json_number(const json_value_t *v, double dflt)
+{
+    if (v == NULL || (v->type != JSON_NUMBER && v->type != JSON_BOOL))
+        return dflt;
+    return v->number;
+}
+
+const char *json_string(const json_value_t *v)
+{
+    if (v == NULL || v->type != JSON_STRING)
+        return NULL;
+    return v->string;
+}
+
+void json_write_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char) *s;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c == '\n')
+            fputs("\\n", fp);
+        else if (c == '\t')
+            fputs("\\t", fp);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
@@ -0,0 +1,48 @@
+#ifndef __JSON_H_
+#define __JSON_H_
+
+/*
+ * json.h - Minimal JSON reader and writer helpers
+ *
+ * Just enough JSON for the driver's machine-readable results: the
+ * reader builds a small tree from a file, and the writer helpers
+ * take care of quoting.  Not a validating parser.
+ */
+
+#include <stdio.h>
+
+typedef enum {
+    JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT
+} json_type_t;
+
+typedef struct json_value {
+    json_type_t type;
+    double number;              /* JSON_NUMBER; 0/1 for JSON_BOOL */
+    char *string;               /* JSON_STRING */
+    int count;                  /* JSON_ARRAY, JSON_OBJECT: # of children */
+    char **keys;                /* JSON_OBJECT: member names */
+    struct json_value **items;  /* JSON_ARRAY, JSON_OBJECT: children */
+} json_value_t;
+
+/* Parse a whole file.  Returns NULL and fills err on failure */
+json_value_t *json_parse_file(const char *path, char *err, size_t errlen);
+
+/* Free a tree returned by json_parse_file */
+void json_free(json_value_t *v);
+
+/* Member of an object, or NULL if v is not an object or has no such key */
+json_value_t *json_get(const json_value_t *v, const char *key);
+
+/* Element i of an array, or NULL */
+json_value_t *json_at(const json_value_t *v, int i);
+
+/* Number (or bool) value of v, or dflt if v is missing or not a number */
+double json_number(const json_value_t *v, double dflt);
+
+/* String value of v, or NULL */
+const char *json_string(const json_value_t *v);
+
+/* Write s to fp as a quoted, escaped JSON string */
+void json_write_string(FILE *fp, const char *s);
+
+#endif /* __JSON_H_ */
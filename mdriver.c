@@ -18,15 +18,23 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <math.h>
 #include <getopt.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fcyc.h"
+#include "clock.h"
 #include "config.h"
-#include "stree.h"
+#include "hist.h"
+#include "perfctr.h"
+#include "json.h"
+#include "mmops.h"
 
 /**********************
  * Constants and macros
@@ -44,9 +52,37 @@
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
 
+/* Rounds size up to a multiple of ALIGNMENT */
+#define ALIGN_UP(size) (((size) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+
 /* weights */
 typedef enum { WNONE, WALL, WUTIL, WPERF } weight_t;
 
+/* Most timing samples kept per trace (--samples) */
+#define MAX_TPUT_SAMPLES 32
+
+/* Exit status when --compare finds a regression */
+#define EXIT_REGRESSION 3
+
+/* With -D, recheck every live block every this many ops (--sweep) */
+#define DEFAULT_SWEEP 1024
+
+/* Operation classes and percentiles reported in latency mode (-L) */
+typedef enum { LAT_MALLOC, LAT_FREE, LAT_REALLOC, LAT_ALL, NUM_LAT_OPS } lat_op_t;
+#define NUM_LAT_PCTS 5
+static const double lat_pcts[NUM_LAT_PCTS] = { 50.0, 90.0, 99.0, 99.9, 100.0 };
+static const char *lat_pct_names[NUM_LAT_PCTS] = { "p50", "p90", "p99", "p99.9", "max" };
+static const char *lat_op_names[NUM_LAT_OPS] = { "malloc", "free", "realloc", "all" };
+
+/* mm.c's timed routines (--cycles), in mm_fn_t order, and short labels */
+static const char *mm_fn_names[MM_NUM_FNS] = {
+    "malloc", "free", "realloc", "find_fit", "place", "coalesce",
+    "add_free_block", "remove_free_block", "extend_heap"
+};
+static const char *mm_fn_labels[MM_NUM_FNS] = {
+    "malloc", "free", "realloc", "fit", "place", "coal", "add", "rm", "extend"
+};
+
 /******************************
  * The key compound data types
  *****************************/
@@ -59,32 +95,52 @@ typedef enum { WNONE, WALL, WUTIL, WPERF } weight_t;
  */
 
 /*
- * Records the extent of each block's payload.
- * Organized as doubly linked list
+ * All information about the set of allocated payloads: a shadow bitmap
+ * with one bit per ALIGNMENT-byte granule of the heap, set for every
+ * granule that some payload touches, plus the indices of the live
+ * blocks.  Since payloads start on granule boundaries, two payloads
+ * overlap exactly when they share a granule.  A second bitmap marks
+ * the first granule of each payload and a small hash table maps it
+ * back to the block index, so the blocks next to an address can be
+ * found without a search.  Everything is allocated up front (the
+ * bitmaps grow with the heap), so no malloc per block.
  */
-typedef struct range_t {
-    char *lo;              /* low payload address */
-    char *hi;              /* high payload address */
-    long index;            /* same index as free; for debugging */
-    struct range_t *next;
-    struct range_t *prev;
-} range_t;
+typedef struct {
+    char *base;            /* address covered by bit 0 of the bitmap */
+    size_t nwords;         /* size of the bitmaps in 64-bit words */
+    uint64_t *shadow;      /* one bit per granule */
+    uint64_t *starts;      /* one bit per granule that starts a payload */
+    size_t *start_keys;    /* hash table: start granule + 1, or 0 if empty... */
+    int *start_index;      /* ...and the index of the block starting there */
+    size_t start_mask;     /* hash table size - 1 */
+    int *live;             /* indices of the live blocks, unordered */
+    int *live_pos;         /* position of each index in live, or -1 */
+    int num_live;          /* number of live blocks */
+} range_set_t;
 
 /*
- * All information about set of ranges represented as doubly-linked
- * list of ranges, plus a splay tree keyed by lo addresses
+ * Characterizes a single trace operation (allocator request), packed
+ * into 64 bits so that replaying a trace streams 8 bytes per request
+ * through the cache rather than 24: the type in bits 0-1, the block
+ * index in bits 2-31 and the size in bits 32-63.  free(NULL) has index
+ * OP_INDEX_NONE.  A request whose index or size does not fit has size
+ * OP_SIZE_ESCAPE, and its real values in the trace's escape table.
+ * Use op_type, op_index and op_size to read them.
  */
-typedef struct {
-    range_t *list;
-    tree_t *lo_tree;
-} range_set_t;
+typedef uint64_t traceop_t;
+typedef enum { ALLOC, FREE, REALLOC } optype_t;
 
-/* Characterizes a single trace operation (allocator request) */
+#define OP_TYPE_BITS 2
+#define OP_INDEX_BITS 30
+#define OP_INDEX_NONE ((UINT64_C(1) << OP_INDEX_BITS) - 1)
+#define OP_SIZE_ESCAPE UINT64_C(0xFFFFFFFF)
+
+/* The real index and size of a request that did not fit in a traceop_t */
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
-    long index;                         /* index for free() to use later */
-    size_t size;                        /* byte size of alloc/realloc request */
-} traceop_t;
+    int opnum;            /* position of the request in the trace */
+    long index;
+    size_t size;
+} op_escape_t;
 
 /* Holds the information for one trace file */
 typedef struct {
@@ -94,11 +150,51 @@ typedef struct {
     int num_ops;          /* number of distinct requests */
     weight_t weight;      /* weight for this trace */
     traceop_t *ops;       /* array of requests */
+    op_escape_t *escapes; /* requests too big to pack, in trace order */
+    int num_escapes;
     char **blocks;        /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes;  /* ... and a corresponding array of payload sizes */
     int *block_rand_base; /* index into random_data, if debug is on */
 } trace_t;
 
+/* Look up the escape table entry of request i */
+static const op_escape_t *op_escape(const trace_t *trace, int i) {
+    int lo = 0, hi = trace->num_escapes - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (trace->escapes[mid].opnum < i)
+            lo = mid + 1;
+        else if (trace->escapes[mid].opnum > i)
+            hi = mid - 1;
+        else
+            return &trace->escapes[mid];
+    }
+    assert(false);
+    return NULL;
+}
+
+static inline optype_t op_type(const trace_t *trace, int i) {
+    return (optype_t) (trace->ops[i] & ((1 << OP_TYPE_BITS) - 1));
+}
+
+static inline long op_index(const trace_t *trace, int i) {
+    traceop_t op = trace->ops[i];
+    uint64_t index = (op >> OP_TYPE_BITS) & OP_INDEX_NONE;
+
+    if (__builtin_expect((op >> 32) == OP_SIZE_ESCAPE, 0))
+        return op_escape(trace, i)->index;
+    return index == OP_INDEX_NONE ? -1 : (long) index;
+}
+
+static inline size_t op_size(const trace_t *trace, int i) {
+    traceop_t op = trace->ops[i];
+
+    if (__builtin_expect((op >> 32) == OP_SIZE_ESCAPE, 0))
+        return op_escape(trace, i)->size;
+    return (size_t) (op >> 32);
+}
+
 /*
  * Holds the params to the xxx_speed functions, which are timed by fcyc.
  * This struct is necessary because fcyc accepts only a pointer array
@@ -120,9 +216,43 @@ typedef struct {
     bool valid;        /* was the trace processed correctly by the allocator? */
     double secs;       /* number of secs needed to run the trace */
     double tput;       /* throughput for this trace in Kops/s */
+    int nsamples;      /* number of independent timing samples... */
+    double tput_samples[MAX_TPUT_SAMPLES]; /* ...and their throughputs */
+    bool converged;    /* did fsec's K-best converge on every sample? */
+
+    /* defined only in robust timing mode (--robust) */
+    bool robust;
+    double tput_best;  /* K-best throughput, Kops/s */
+    double tput_ci[2]; /* bootstrap 95% confidence interval of tput */
+
+    /* defined only in baseline mode (--baseline) */
+    bool base_valid;
+    double base_secs;  /* secs for the same run against the null allocator */
+
+    /* defined only in cold-cache mode (--cold) */
+    bool cold_valid;
+    double tput_cold;  /* throughput with the cache cleared before each run */
 
     /* defined only for the student malloc package */
     double util;       /* space utilization for this trace (always 0 for libc) */
+    double heap_bytes; /* heap size after the trace */
+    double peak_bytes; /* peak live payload bytes */
+    double bound_bytes;/* peak live bytes with every block rounded up to
+                          ALIGNMENT: no aligned allocator's heap is smaller */
+    bool mm_valid;     /* does the allocator keep counters (mm_stats)? */
+    mm_stats_t mm;     /* its counters at the end of the util run */
+    bool cycles_valid; /* does it account its cycles (mm_cycles)? */
+    mm_cycles_t cycles;/* its cycle accounts for the util run */
+
+    /* defined only in latency mode (-L): per-op percentiles, in ns if
+       the tick rate is known (lat_ns) and in raw ticks if not */
+    bool lat_valid;
+    bool lat_ns;
+    double lat[NUM_LAT_OPS][NUM_LAT_PCTS];
+
+    /* defined only in counter mode (-P): events per op, -1 if unavailable */
+    bool perf_valid;
+    double perf[PC_NUM];
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -135,19 +265,29 @@ typedef struct {
     double tput;  /* average throughput expressed in Kops/s */
 } sum_stats_t;
 
+/* The two files of a trace's fragmentation timeline (-F) */
+typedef struct {
+    FILE *csv;    /* <trace>.frag.csv, one row per sample */
+    FILE *json;   /* <trace>.frag.json, the same samples as objects */
+    int samples;  /* rows written so far */
+} timeline_t;
+
 /********************
  * For debugging.  If debug-mode is on, then we have each block start
  * at a "random" place (a hash of the index), and copy random data
- * into it.  With DBG_CHEAP, we check that the data survived when we
- * realloc and when we free.  With DBG_EXPENSIVE, we check every block
- * every operation.
+ * into the first and last maxfill bytes of it.  With DBG_CHEAP, we
+ * check that the data survived when we realloc and when we free.  With
+ * DBG_EXPENSIVE, we check every block every operation.
  * randint_t should be a byte, in case students return unaligned memory.
+ * random_data repeats its first MAXFILL bytes at the end, so the fill
+ * pattern for any offset is contiguous and can be copied and compared
+ * with memcpy/memcmp rather than a byte at a time.
  *******************/
 #define RANDOM_DATA_LEN (1<<16)
 
 typedef unsigned char randint_t;
 static const char randint_t_name[] = "byte";
-static randint_t random_data[RANDOM_DATA_LEN];
+static randint_t random_data[RANDOM_DATA_LEN + MAXFILL];
 
 
 /********************
@@ -162,6 +302,27 @@ int verbose = REF_ONLY ? 0 : 1;  /* global flag for verbose output */
 static int errors = 0;           /* number of errs found when running student malloc */
 static bool onetime_flag = false;
 static bool tab_mode = false;     /* Print output as tab-separated fields */
+static bool latency_mode = false; /* Record per-op latency histograms */
+static bool perf_mode = false;    /* Read hardware performance counters */
+static bool have_counters = false; /* Were the counters opened? */
+static int frag_interval = 0;     /* Sample fragmentation every K ops (-F) */
+static int timing_samples = 1;    /* Independent fsec samples per trace */
+static int sweep_interval = DEFAULT_SWEEP; /* -D full recheck period */
+static int robust_samples = 0;    /* --robust: fsec samples per trace */
+static int warmup_runs = 0;       /* --warmup: untimed runs before timing */
+static int pin_cpu = -1;          /* --pin: CPU to run on, or -1 */
+static bool tsc_timer = false;    /* --tsc: time fsec with the TSC */
+/* --cold: also time each trace with the cache cleared before each run */
+typedef enum { COLD_NONE, COLD_SWEEP, COLD_CLFLUSH } cold_mode_t;
+static cold_mode_t cold_mode = COLD_NONE;
+static long cold_line = 64;       /* cache line size, for clflush */
+static bool baseline_mode = false; /* --baseline: subtract driver overhead */
+static bool bound_mode = false;   /* --bound: report the gap to the bound */
+static bool heap_profile = false; /* --heap-profile: dump at the peak */
+static bool event_trace = false;  /* --events: dump mm.c's event ring */
+static bool cycles_mode = false;  /* --cycles: per-routine cycle breakdown */
+static bool heap_map = false;     /* --heap-map: snapshot at the peak */
+static double regress_threshold = 5.0; /* % drop counted as a regression */
 /* If set, use sparse memory emulation */
 static bool sparse_mode = SPARSE_MODE;
 static size_t maxfill = SPARSE_MODE ? MAXFILL_SPARSE : MAXFILL;
@@ -185,6 +346,11 @@ static char **global_tracefiles = NULL;
 
 static char autoresult[MAXLINE]; /* autoresult string */
 
+/* The allocator under test; -a adds more to compare against */
+static const mm_ops_t *mm = &mm_builtin_ops;
+static int num_extra_allocs = 0;
+static mm_ops_t **extra_allocs = NULL;
+
 /* Summary statistics for libc and student's mm.c submissions */
 static sum_stats_t global_libc_sum_stats;
 static sum_stats_t global_mm_sum_stats;
@@ -199,20 +365,27 @@ static sum_stats_t global_mm_sum_stats;
 static void add_tracefile(char *trace);
 
 /* these functions manipulate range sets */
-static range_set_t *new_range_set();
+static range_set_t *new_range_set(const trace_t *trace);
 static bool add_range(range_set_t *ranges, char *lo, size_t size,
                       const trace_t *trace, int opnum, int index);
-static void remove_range(range_set_t *ranges, char *lo);
+static void remove_range(range_set_t *ranges, const trace_t *trace, int index);
+static void clear_range_set(range_set_t *ranges, const trace_t *trace);
 static void free_range_set(range_set_t *ranges);
 
 /* These functions implement the debugging code */
 static void init_random_data(void);
 static bool check_index(const trace_t *trace, int opnum, int index);
+static bool check_block(const trace_t *trace, int opnum, int index,
+                        size_t filled, size_t limit);
+static bool check_neighbours(const trace_t *trace, const range_set_t *ranges,
+                             int opnum, const char *lo, size_t size);
 static void randomize_block(trace_t *trace, int index);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(stats_t *stats, const char *tracedir,
                            const char *filename);
+static void pack_op(trace_t *trace, int i, optype_t type, long index,
+                    size_t size);
 static void reinit_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
 
@@ -223,11 +396,33 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static bool eval_mm_valid(trace_t *trace, range_set_t *ranges);
-static double eval_mm_util(trace_t *trace, int tracenum);
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static void output_name(const trace_t *trace, const char *suffix, char *name);
+static void open_timeline(const trace_t *trace, timeline_t *tl);
+static void close_timeline(timeline_t *tl);
+static int peak_op(const trace_t *trace);
+static void dump_profile(const trace_t *trace);
+static void dump_events(const trace_t *trace);
+static void dump_heap_map(const trace_t *trace);
+static void sample_timeline(timeline_t *tl, int opnum, size_t live_bytes);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
+static void printlatency(int n, stats_t *stats);
+static void printperf(int n, stats_t *stats);
+static void printtiming(int n, stats_t *stats);
+static void printcold(int n, stats_t *stats);
+static void printoverhead(int n, stats_t *stats);
+static void printbound(int n, stats_t *stats);
+static void printcycles(int n, stats_t *stats);
+static void printcomparison(int n, stats_t **stats, const int *errs);
+static void write_json(const char *path, int n, stats_t *stats,
+                       double avg_util, double avg_tput, double perfindex,
+                       int argc, char **argv);
+static int compare_results(const char *path, int n, stats_t *stats);
+static void write_mm_stats(FILE *fp, const mm_stats_t *ms);
 static void usage(char *prog);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -254,61 +449,400 @@ long int random(void)
 #endif
 
 /*
- * Run the tests; return the number of tests run (may be less than
- * num_tracefiles, if there's a timeout)
+ * Timing lock for parallel mode: a write lock on an unlinked temporary
+ * file, which a worker must take before its timing runs and drop
+ * afterwards, so that timed runs of different traces never overlap.
+ * fcntl locks belong to the process, so the kernel drops the lock when
+ * a worker dies holding it.
  */
-static void run_tests(int num_tracefiles, const char *tracedir,
-                      char **tracefiles,
-                      stats_t *mm_stats, speed_t *speed_params) {
-    volatile int i;
+static int timing_lock = -1;
+static volatile bool holding_lock = false;
+
+static void timing_lock_op(short type) {
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    while (fcntl(timing_lock, F_SETLKW, &fl) < 0) {
+        if (errno != EINTR)
+            unix_error("fcntl on timing lock failed");
+    }
+}
 
-    for (i=0; i < num_tracefiles; i++) {
-        /* initialize simulated memory system in memlib.c *
-         * start each trace with a clean system */
-        mem_init(sparse_mode);
-        range_set_t *ranges = new_range_set();
+static void acquire_timing_slot(void) {
+    if (timing_lock < 0)
+        return;
+    timing_lock_op(F_WRLCK);
+    holding_lock = true;
+}
+
+static void release_timing_slot(void) {
+    if (!holding_lock)
+        return;
+    timing_lock_op(F_UNLCK);
+    holding_lock = false;
+}
 
+/*
+ * flush_heap - Evict the allocator's whole heap from every level of
+ *     the cache, for --cold clflush
+ */
+static void flush_heap(void *arg __attribute__((unused))) {
+#if defined(__x86_64__) || defined(__i386__)
+    char *p = (char *) ((unsigned long) mm->heap_lo() & ~(cold_line - 1));
+    char *hi = (char *) mm->heap_hi();
+
+    for (; p <= hi; p += cold_line)
+        _mm_clflush(p);
+    _mm_mfence();
+#endif
+}
 
-        // NOTE: If times out, then it will reread the trace file
+/*
+ * setup_cold_mode - Size the cache sweep to the last-level cache, or
+ *     install flush_heap, for --cold
+ */
+static void setup_cold_mode(void) {
+    long line = 0;
+    long llc = fcyc_llc_bytes(&line);
+
+    if (line > 0)
+        cold_line = line;
+#if !defined(__x86_64__) && !defined(__i386__)
+    if (cold_mode == COLD_CLFLUSH) {
+        fprintf(stderr, "Warning: no clflush on this machine; "
+                "sweeping the cache instead\n");
+        cold_mode = COLD_SWEEP;
+    }
+#endif
+    if (cold_mode == COLD_CLFLUSH) {
+        set_fcyc_clear_funct(flush_heap, NULL);
+        return;
+    }
+    if (llc == 0) {
+        llc = 32 << 20;
+        fprintf(stderr, "Warning: LLC size unknown; sweeping %ld MB\n",
+                2 * llc >> 20);
+    }
+    /* Twice the LLC, since replacement is not strictly LRU */
+    set_fcyc_cache_size(2 * llc);
+    set_fcyc_cache_block(cold_line);
+}
 
-        trace_t *trace;
-        trace = read_trace(&mm_stats[i], tracedir, tracefiles[i]);
-        strcpy(mm_stats[i].filename, trace->filename);
-        mm_stats[i].ops = trace->num_ops;
+/*
+ * Run one trace: check correctness, then measure utilization and
+ * throughput, filling in mm_stats[i].  Returns false if no further
+ * traces should be run (-c mode).
+ */
+static bool run_trace(int i, const char *tracedir, char **tracefiles,
+                      stats_t *mm_stats, speed_t *speed_params) {
+    /* initialize simulated memory system in memlib.c *
+     * start each trace with a clean system */
+    mem_init(sparse_mode);
+
+    // NOTE: If times out, then it will reread the trace file
+
+    trace_t * volatile trace;
+    trace = read_trace(&mm_stats[i], tracedir, tracefiles[i]);
+    range_set_t * volatile ranges = new_range_set(trace);
+    strcpy(mm_stats[i].filename, trace->filename);
+    mm_stats[i].ops = trace->num_ops;
+
+    /* Prepare for timeout */
+    if (setjmp(timeout_jmpbuf) != 0) {
+        mm_stats[i].valid = false;
+        release_timing_slot();
+    } else {
+        if (verbose > 1)
+            printf("Checking mm_malloc for correctness, ");
+        mm_stats[i].valid =
+            /* Do 2 tests, since may fail to reinitialize properly */
+            eval_mm_valid(trace, ranges) && eval_mm_valid(trace, ranges);
 
-        /* Prepare for timeout */
-        if (setjmp(timeout_jmpbuf) != 0) {
-            mm_stats[i].valid = false;
+        if (onetime_flag) {
+            free_trace(trace);
+            return false;
+        }
+    }
+    if (mm_stats[i].valid) {
+        if (verbose > 1)
+            printf("efficiency, ");
+        mm_stats[i].util = eval_mm_util(trace, i, &mm_stats[i]);
+        speed_params->trace = trace;
+        speed_params->ranges = ranges;
+        if (verbose > 1)
+            printf("and performance.\n");
+        acquire_timing_slot();
+        if (sparse_mode) {
+            mm_stats[i].secs = 1.0;
+        } else if (robust_samples > 0) {
+            /* One long measurement, scored by its median; its samples
+               are what comparisons judge the noise by */
+            fcyc_stats_t fs;
+            int k;
+            double ops = mm_stats[i].ops;
+            fsec_stats(eval_mm_speed, speed_params, &fs);
+            mm_stats[i].nsamples =
+                fs.nsamples < MAX_TPUT_SAMPLES ? fs.nsamples : MAX_TPUT_SAMPLES;
+            for (k = 0; k < mm_stats[i].nsamples; k++)
+                mm_stats[i].tput_samples[k] = ops / (fs.samples[k] * 1000.0);
+            mm_stats[i].converged = fs.converged;
+            mm_stats[i].robust = true;
+            mm_stats[i].secs = fs.median;
+            mm_stats[i].tput_best = ops / (fs.best * 1000.0);
+            /* Throughput falls as time rises, so the ends swap */
+            mm_stats[i].tput_ci[0] = ops / (fs.ci_hi * 1000.0);
+            mm_stats[i].tput_ci[1] = ops / (fs.ci_lo * 1000.0);
         } else {
-            if (verbose > 1)
-                printf("Checking mm_malloc for correctness, ");
-            mm_stats[i].valid =
-                /* Do 2 tests, since may fail to reinitialize properly */
-                eval_mm_valid(trace, ranges) && eval_mm_valid(trace, ranges);
+            /* Keep every sample so comparisons can judge the noise */
+            int k;
+            double sumsecs = 0;
+            mm_stats[i].nsamples = timing_samples;
+            mm_stats[i].converged = true;
+            for (k = 0; k < timing_samples; k++) {
+                fcyc_stats_t fs;
+                double secs = fsec_stats(eval_mm_speed, speed_params, &fs);
+                mm_stats[i].tput_samples[k] = mm_stats[i].ops / (secs * 1000.0);
+                mm_stats[i].converged = mm_stats[i].converged && fs.converged;
+                sumsecs += secs;
+            }
+            mm_stats[i].secs = sumsecs / timing_samples;
+        }
+        mm_stats[i].tput = mm_stats[i].ops / (mm_stats[i].secs * 1000.0);
+        if (baseline_mode && !sparse_mode) {
+            /* The same loop against the null allocator: what is left
+               is the driver's own cost */
+            const mm_ops_t *saved = mm;
+            mm = &mm_null_ops;
+            mm_stats[i].base_secs = fsec(eval_mm_speed, speed_params);
+            mm = saved;
+            mm_stats[i].base_valid = true;
+        }
+        if (cold_mode != COLD_NONE && !sparse_mode) {
+            set_fcyc_clear_cache(FCYC_CLEAR_EACH_REP);
+            mm_stats[i].tput_cold =
+                mm_stats[i].ops / (fsec(eval_mm_speed, speed_params) * 1000.0);
+            set_fcyc_clear_cache(0);
+            mm_stats[i].cold_valid = true;
+        }
+        if (latency_mode && !sparse_mode)
+            eval_mm_latency(trace, &mm_stats[i]);
+        if (have_counters) {
+            int j;
+            /* One extra warm run, wrapped by the counters */
+            perfctr_start();
+            eval_mm_speed(speed_params);
+            perfctr_stop(mm_stats[i].perf);
+            for (j = 0; j < PC_NUM; j++)
+                if (mm_stats[i].perf[j] >= 0)
+                    mm_stats[i].perf[j] /= mm_stats[i].ops;
+            mm_stats[i].perf_valid = true;
+        }
+        release_timing_slot();
+    }
 
-            if (onetime_flag) {
-                free_trace(trace);
-                return;
+    free_trace(trace);
+    free_range_set(ranges);
+
+    /* clean up memory system */
+    mem_deinit();
+    return true;
+}
+
+/* What a parallel worker sends back to the parent */
+typedef struct {
+    stats_t stats;
+    int errors;
+} worker_result_t;
+
+/*
+ * run_worker - Body of a forked worker: evaluate trace i in this
+ *     process, with its own memlib heap, and write the result to fd.
+ */
+static void run_worker(int i, int fd, const char *tracedir, char **tracefiles,
+                       stats_t *mm_stats, speed_t *speed_params) {
+    worker_result_t res;
+    char *buf = (char *) &res;
+    size_t left = sizeof(res);
+
+    /* Report only this trace's errors; the parent already has its own */
+    errors = 0;
+    /* Pending alarms are not inherited, so give each worker its own */
+    if (set_timeout > 0)
+        alarm(set_timeout);
+    /* Counters opened by the parent only count the parent */
+    if (have_counters)
+        have_counters = perfctr_open() > 0;
+
+    run_trace(i, tracedir, tracefiles, mm_stats, speed_params);
+
+    res.stats = mm_stats[i];
+    res.errors = errors;
+    while (left > 0) {
+        ssize_t n = write(fd, buf, left);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            _exit(1);
+        buf += n;
+        left -= n;
+    }
+    _exit(0);
+}
+
+/*
+ * run_tests_parallel - Evaluate the traces in up to njobs forked worker
+ *     processes, collecting each stats_t over a pipe.  The timing runs
+ *     are serialized through timing_lock, but the other workers' checks
+ *     and utilization runs go on meanwhile and compete for the caches
+ *     and memory bandwidth, so throughput is only comparable between
+ *     runs with the same -j.
+ */
+static void run_tests_parallel(int num_tracefiles, const char *tracedir,
+                               char **tracefiles, stats_t *mm_stats,
+                               speed_t *speed_params, int njobs) {
+    pid_t *pids = calloc(num_tracefiles, sizeof(pid_t));
+    int *fds = calloc(num_tracefiles, sizeof(int));
+    worker_result_t *results = calloc(num_tracefiles, sizeof(worker_result_t));
+    size_t *got = calloc(num_tracefiles, sizeof(size_t));
+    struct pollfd *pfds = calloc(njobs, sizeof(struct pollfd));
+    int *slots = calloc(njobs, sizeof(int));
+    int next = 0, running = 0, done = 0;
+    int i, k;
+    char drain;
+    char lockpath[] = "/tmp/mdriver-lock-XXXXXX";
+
+    if (pids == NULL || fds == NULL || results == NULL || got == NULL ||
+        pfds == NULL || slots == NULL)
+        unix_error("calloc in run_tests_parallel failed");
+    if ((timing_lock = mkstemp(lockpath)) < 0)
+        unix_error("mkstemp in run_tests_parallel failed");
+    unlink(lockpath);
+
+    /* Workers carry their own timeouts */
+    alarm(0);
+
+    while (done < num_tracefiles) {
+        /* Keep up to njobs workers busy */
+        while (running < njobs && next < num_tracefiles) {
+            int fd[2];
+            if (pipe(fd) < 0)
+                unix_error("pipe in run_tests_parallel failed");
+            pids[next] = fork();
+            if (pids[next] < 0)
+                unix_error("fork in run_tests_parallel failed");
+            if (pids[next] == 0) {
+                close(fd[0]);
+                run_worker(next, fd[1], tracedir, tracefiles,
+                           mm_stats, speed_params);
             }
+            close(fd[1]);
+            fds[next] = fd[0];
+            next++;
+            running++;
         }
-        if (mm_stats[i].valid) {
-            if (verbose > 1)
-                printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i);
-            speed_params->trace = trace;
-            speed_params->ranges = ranges;
-            if (verbose > 1)
-                printf("and performance.\n");
-            mm_stats[i].secs = sparse_mode ? 1.0 : fsec(eval_mm_speed, speed_params);
-            mm_stats[i].tput = mm_stats[i].ops / (mm_stats[i].secs * 1000.0);
+
+        /* Drain the pipes first: a worker blocked writing a result
+           larger than the pipe buffer would never exit */
+        int npoll = 0;
+        for (i = 0; i < next; i++) {
+            if (pids[i] > 0) {
+                pfds[npoll].fd = fds[i];
+                pfds[npoll].events = POLLIN;
+                slots[npoll++] = i;
+            }
+        }
+        if (poll(pfds, npoll, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            unix_error("poll in run_tests_parallel failed");
+        }
+        for (k = 0; k < npoll; k++) {
+            if (pfds[k].revents == 0)
+                continue;
+            i = slots[k];
+            char *buf = (char *) &results[i];
+            ssize_t n = got[i] < sizeof(worker_result_t) ?
+                read(fds[i], buf + got[i], sizeof(worker_result_t) - got[i]) :
+                read(fds[i], &drain, 1);
+            if (n > 0) {
+                got[i] += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+
+            /* End of file: the worker is done, so reap it */
+            int status = 0;
+            while (waitpid(pids[i], &status, 0) < 0) {
+                if (errno != EINTR)
+                    unix_error("waitpid in run_tests_parallel failed");
+            }
+            if (got[i] == sizeof(worker_result_t)) {
+                mm_stats[i] = results[i].stats;
+                errors += results[i].errors;
+            } else {
+                /* The worker died before reporting, e.g. on a segfault */
+                stats_t dummy;
+                trace_t *trace = read_trace(&dummy, tracedir, tracefiles[i]);
+                strcpy(mm_stats[i].filename, trace->filename);
+                mm_stats[i].weight = trace->weight;
+                mm_stats[i].ops = trace->num_ops;
+                mm_stats[i].valid = false;
+                free_trace(trace);
+                errors++;
+                if (WIFSIGNALED(status))
+                    printf("ERROR [trace %s]: worker killed by signal %d\n",
+                           mm_stats[i].filename, WTERMSIG(status));
+                else
+                    printf("ERROR [trace %s]: worker exited without a result\n",
+                           mm_stats[i].filename);
+            }
+            close(fds[i]);
+            pids[i] = 0;
+            running--;
+            done++;
         }
+    }
+
+    close(timing_lock);
+    timing_lock = -1;
+    free(pids);
+    free(fds);
+    free(results);
+    free(got);
+    free(pfds);
+    free(slots);
+}
+
+/*
+ * Run the tests, one trace after another, or in up to njobs worker
+ * processes when njobs > 1
+ */
+static void run_tests(int num_tracefiles, const char *tracedir,
+                      char **tracefiles,
+                      stats_t *mm_stats, speed_t *speed_params, int njobs) {
+    int i;
 
-        free_trace(trace);
-        free_range_set(ranges);
+    if (perf_mode && !sparse_mode) {
+        have_counters = perfctr_open() > 0;
+        if (!have_counters)
+            fprintf(stderr, "Warning: hardware performance counters "
+                    "unavailable (check perf_event_paranoid); "
+                    "ignoring -P\n");
+    }
 
-        /* clean up memory system */
-        mem_deinit();
+    if (njobs > 1 && !onetime_flag) {
+        run_tests_parallel(num_tracefiles, tracedir, tracefiles,
+                           mm_stats, speed_params, njobs);
+    } else {
+        for (i=0; i < num_tracefiles; i++) {
+            if (!run_trace(i, tracedir, tracefiles, mm_stats, speed_params))
+                break;
+        }
     }
+    if (have_counters)
+        perfctr_close();
 }
 
 /**************
@@ -327,6 +861,9 @@ int main(int argc, char **argv)
     bool run_libc = false;     /* If set, run libc malloc (set by -l) */
     bool autograder = false;   /* if set then called by autograder (-A) */
     bool checkpoint = false;
+    int njobs = 1;             /* number of parallel workers (set by -j) */
+    char *json_path = NULL;    /* write results as JSON (set by --json) */
+    char *compare_path = NULL; /* baseline JSON to compare against */
 
     /* temporaries used to compute the performance index */
     double secs, ops, tput, tput_geom, util;
@@ -344,13 +881,121 @@ int main(int argc, char **argv)
 
 #if !REF_ONLY
 
-    char c;
+    int c;
+    static struct option long_options[] = {
+        { "json",      required_argument, NULL, 'J' },
+        { "compare",   required_argument, NULL, 'C' },
+        { "threshold", required_argument, NULL, 'R' },
+        { "samples",   required_argument, NULL, 'S' },
+        { "sweep",     required_argument, NULL, 'W' },
+        { "robust",    required_argument, NULL, 'B' },
+        { "warmup",    required_argument, NULL, 'U' },
+        { "pin",       required_argument, NULL, 'N' },
+        { "tsc",       no_argument,       NULL, 'X' },
+        { "cold",      required_argument, NULL, 'Y' },
+        { "baseline",  no_argument,       NULL, 'Z' },
+        { "bound",     no_argument,       NULL, 'G' },
+        { "heap-profile", no_argument,    NULL, 'Q' },
+        { "events",    no_argument,       NULL, 'E' },
+        { "cycles",    no_argument,       NULL, 'K' },
+        { "heap-map",  no_argument,       NULL, 'M' },
+        { NULL, 0, NULL, 0 }
+    };
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hpOVAlDT")) != EOF) {
+    while ((c = getopt_long(argc, argv, "a:d:f:c:j:s:t:v:F:hpOVAlDLPT",
+                            long_options, NULL)) != EOF) {
         switch (c) {
 
+        case 'a': { /* Compare against an allocator in a shared object */
+            char err[MAXLINE];
+            mm_ops_t *ops = mm_ops_load(optarg, err, sizeof(err));
+            if (ops == NULL)
+                app_error("Could not load allocator: %s\n", err);
+            extra_allocs = realloc(extra_allocs,
+                                   (num_extra_allocs + 1) * sizeof(mm_ops_t *));
+            extra_allocs[num_extra_allocs++] = ops;
+            break;
+        }
+
+        case 'J': /* --json <file> */
+            json_path = optarg;
+            break;
+
+        case 'C': /* --compare <baseline.json> */
+            compare_path = optarg;
+            break;
+
+        case 'R': /* --threshold <percent> */
+            regress_threshold = atof(optarg);
+            break;
+
+        case 'S': /* --samples <n> */
+            timing_samples = atoi(optarg);
+            if (timing_samples < 1)
+                timing_samples = 1;
+            if (timing_samples > MAX_TPUT_SAMPLES)
+                timing_samples = MAX_TPUT_SAMPLES;
+            break;
+
+        case 'W': /* --sweep <k> */
+            sweep_interval = atoi(optarg);
+            if (sweep_interval < 1)
+                sweep_interval = 1;
+            break;
+
+        case 'B': /* --robust <n> */
+            robust_samples = atoi(optarg);
+            if (robust_samples < 0)
+                robust_samples = 0;
+            break;
+
+        case 'U': /* --warmup <n> */
+            warmup_runs = atoi(optarg);
+            break;
+
+        case 'N': /* --pin <cpu> */
+            pin_cpu = atoi(optarg);
+            break;
+
+        case 'X': /* --tsc */
+            tsc_timer = true;
+            break;
+
+        case 'Y': /* --cold sweep|clflush */
+            if (strcmp(optarg, "sweep") == 0)
+                cold_mode = COLD_SWEEP;
+            else if (strcmp(optarg, "clflush") == 0)
+                cold_mode = COLD_CLFLUSH;
+            else
+                app_error("--cold takes sweep or clflush, not %s", optarg);
+            break;
+
+        case 'Z': /* --baseline */
+            baseline_mode = true;
+            break;
+
+        case 'Q': /* --heap-profile */
+            heap_profile = true;
+            break;
+
+        case 'E': /* --events */
+            event_trace = true;
+            break;
+
+        case 'K': /* --cycles */
+            cycles_mode = true;
+            break;
+
+        case 'M': /* --heap-map */
+            heap_map = true;
+            break;
+
+        case 'G': /* --bound */
+            bound_mode = true;
+            break;
+
         case 'A': /* Hidden Autolab driver argument */
             autograder = true;
             break;
@@ -401,10 +1046,28 @@ int main(int argc, char **argv)
             set_timeout = atoi(optarg);
             break;
 
+        case 'F':
+            frag_interval = atoi(optarg);
+            break;
+
+        case 'j':
+            njobs = atoi(optarg);
+            if (njobs < 1)
+                njobs = 1;
+            break;
+
         case 'T':
             tab_mode = true;
             break;
 
+        case 'L':
+            latency_mode = true;
+            break;
+
+        case 'P':
+            perf_mode = true;
+            break;
+
         case 'h': /* Print this message */
             usage(argv[0]);
             exit(0);
@@ -426,6 +1089,21 @@ int main(int argc, char **argv)
         init_random_data();
     }
 
+    /* Set up the timing environment */
+    if (pin_cpu >= 0 && fcyc_pin_cpu(pin_cpu) < 0)
+        fprintf(stderr, "Warning: could not pin to CPU %d: %s\n",
+                pin_cpu, strerror(errno));
+    set_fcyc_warmup(warmup_runs);
+    if (tsc_timer && !use_tsc_timer(1))
+        fprintf(stderr, "Warning: no stable invariant TSC; "
+                "timing with the CPU-time clock\n");
+    if (cold_mode != COLD_NONE)
+        setup_cold_mode();
+    /* Calibrate now, not once in every parallel worker */
+    if (latency_mode)
+        ticks_ns();
+    set_fcyc_min_samples(robust_samples);
+
     /* Initialize the timeout */
     if (set_timeout > 0) {
         signal(SIGALRM, timeout_handler);
@@ -480,7 +1158,7 @@ int main(int argc, char **argv)
         unix_error("mm_stats calloc in main failed");
 
     run_tests(num_global_tracefiles, tracedir, global_tracefiles, mm_stats,
-              &speed_params);
+              &speed_params, njobs);
 
 
     /* Display the mm results in a compact table */
@@ -497,7 +1175,65 @@ int main(int argc, char **argv)
             printf("\nResults for mm malloc:\n");
             printresults(num_global_tracefiles, mm_stats, &global_mm_sum_stats);
             printf("\n");
+            if (latency_mode) {
+                printlatency(num_global_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (perf_mode)
+                printperf(num_global_tracefiles, mm_stats);
+            printtiming(num_global_tracefiles, mm_stats);
+            if (cold_mode != COLD_NONE)
+                printcold(num_global_tracefiles, mm_stats);
+            if (baseline_mode)
+                printoverhead(num_global_tracefiles, mm_stats);
+            if (bound_mode)
+                printbound(num_global_tracefiles, mm_stats);
+            if (cycles_mode)
+                printcycles(num_global_tracefiles, mm_stats);
+        }
+    }
+
+    /*
+     * Optionally run every trace against each allocator loaded with -a,
+     * on fresh heaps, and compare them side by side
+     */
+    if (num_extra_allocs > 0 && !onetime_flag) {
+        stats_t **all_stats = calloc(num_extra_allocs + 1, sizeof(stats_t *));
+        int *all_errors = calloc(num_extra_allocs + 1, sizeof(int));
+        sum_stats_t extra_sum_stats;
+        int a;
+
+        if (all_stats == NULL || all_errors == NULL)
+            unix_error("all_stats calloc in main failed");
+        all_stats[0] = mm_stats;
+        /* Each allocator counts its own errors, so a broken comparison
+           allocator cannot fail mm.c's run */
+        all_errors[0] = errors;
+        for (a = 0; a < num_extra_allocs; a++) {
+            mm = extra_allocs[a];
+            errors = 0;
+            if (verbose > 1)
+                printf("\nTesting %s\n", mm->name);
+            all_stats[a+1] = calloc(num_global_tracefiles, sizeof(stats_t));
+            if (all_stats[a+1] == NULL)
+                unix_error("stats calloc in main failed");
+            run_tests(num_global_tracefiles, tracedir, global_tracefiles,
+                      all_stats[a+1], &speed_params, njobs);
+            all_errors[a+1] = errors;
+            if (verbose) {
+                printf("\nResults for %s:\n", mm->name);
+                printresults(num_global_tracefiles, all_stats[a+1],
+                             &extra_sum_stats);
+                printf("\n");
+            }
         }
+        mm = &mm_builtin_ops;
+        errors = all_errors[0];
+        printcomparison(num_global_tracefiles, all_stats, all_errors);
+        for (a = 0; a < num_extra_allocs; a++)
+            free(all_stats[a+1]);
+        free(all_stats);
+        free(all_errors);
     }
 
     /* Optionally compare the performance of mm and libc */
@@ -642,6 +1378,14 @@ int main(int argc, char **argv)
                 avg_mm_geom_throughput, avg_mm_util*100);
         printf("%s\n", autoresult);
     }
+
+    /* Optionally save machine-readable results and gate on a baseline */
+    if (json_path)
+        write_json(json_path, num_global_tracefiles, mm_stats, avg_mm_util,
+                   avg_mm_geom_throughput, score, argc, argv);
+    if (compare_path &&
+        compare_results(compare_path, num_global_tracefiles, mm_stats) > 0)
+        exit(EXIT_REGRESSION);
     exit(0);
 }
 
@@ -658,26 +1402,213 @@ static void add_tracefile(char *trace) {
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps
+ * The following routines manipulate the range set, which keeps
  * track of the extent of every allocated block payload. We use the
- * range list to detect any overlapping allocated blocks.
+ * range set to detect any overlapping allocated blocks.
  ****************************************************************/
 
+#define GRANULE_WORD(g) ((g) / 64)
+#define GRANULE_BIT(g) ((uint64_t) 1 << ((g) % 64))
+
 /*
- * new_range_set - Create an empty range set
+ * new_range_set - Create an empty range set for trace
  */
-static range_set_t *new_range_set() {
-    range_set_t *ranges = (range_set_t *) malloc(sizeof(range_set_t));
-    ranges->list = NULL;
-    ranges->lo_tree = tree_new();
+static range_set_t *new_range_set(const trace_t *trace) {
+    range_set_t *ranges = (range_set_t *) calloc(1, sizeof(range_set_t));
+    int i;
+
+    size_t hsize = 16;
+
+    /* At most num_ids blocks are live, so keep the table half empty */
+    while (hsize < 2 * (size_t) trace->num_ids)
+        hsize *= 2;
+    if (ranges == NULL ||
+        (ranges->live = malloc(trace->num_ids * sizeof(int))) == NULL ||
+        (ranges->live_pos = malloc(trace->num_ids * sizeof(int))) == NULL ||
+        (ranges->start_keys = calloc(hsize, sizeof(size_t))) == NULL ||
+        (ranges->start_index = malloc(hsize * sizeof(int))) == NULL)
+        unix_error("malloc error in new_range_set");
+    ranges->start_mask = hsize - 1;
+    for (i = 0; i < trace->num_ids; i++)
+        ranges->live_pos[i] = -1;
     return ranges;
 }
 
+/*
+ * start_slot - Home slot of start granule g in the hash table
+ */
+static size_t start_slot(const range_set_t *ranges, size_t g) {
+    return (size_t) (((uint64_t) g * 0x9E3779B97F4A7C15ULL) >> 32) &
+        ranges->start_mask;
+}
+
+/*
+ * start_find - Slot holding start granule g, or the empty slot where
+ *     it would go
+ */
+static size_t start_find(const range_set_t *ranges, size_t g) {
+    size_t h = start_slot(ranges, g);
+
+    while (ranges->start_keys[h] != 0 && ranges->start_keys[h] != g + 1)
+        h = (h + 1) & ranges->start_mask;
+    return h;
+}
+
+/*
+ * start_insert - Record that block index starts at granule g
+ */
+static void start_insert(range_set_t *ranges, size_t g, int index) {
+    size_t h = start_find(ranges, g);
+
+    ranges->starts[GRANULE_WORD(g)] |= GRANULE_BIT(g);
+    ranges->start_keys[h] = g + 1;
+    ranges->start_index[h] = index;
+}
+
+/*
+ * start_remove - Forget the block starting at granule g.  Later
+ *     entries of the probe run are shifted back over the hole, so
+ *     lookups never need tombstones.
+ */
+static void start_remove(range_set_t *ranges, size_t g) {
+    size_t mask = ranges->start_mask;
+    size_t h = start_find(ranges, g);
+    size_t j;
+
+    ranges->starts[GRANULE_WORD(g)] &= ~GRANULE_BIT(g);
+    if (ranges->start_keys[h] == 0)
+        return;
+    for (j = (h + 1) & mask; ranges->start_keys[j] != 0; j = (j + 1) & mask) {
+        size_t home = start_slot(ranges, ranges->start_keys[j] - 1);
+        if (((j - home) & mask) >= ((j - h) & mask)) {
+            ranges->start_keys[h] = ranges->start_keys[j];
+            ranges->start_index[h] = ranges->start_index[j];
+            h = j;
+        }
+    }
+    ranges->start_keys[h] = 0;
+}
+
+/*
+ * start_before - Index of the live block starting closest below
+ *     granule g, or -1 if there is none
+ */
+static int start_before(const range_set_t *ranges, size_t g) {
+    size_t w;
+    uint64_t bits;
+
+    if (g == 0 || ranges->nwords == 0)
+        return -1;
+    g--;
+    if (GRANULE_WORD(g) >= ranges->nwords)
+        g = ranges->nwords * 64 - 1;
+    w = GRANULE_WORD(g);
+    bits = ranges->starts[w] & (GRANULE_BIT(g) | (GRANULE_BIT(g) - 1));
+    while (bits == 0) {
+        if (w == 0)
+            return -1;
+        bits = ranges->starts[--w];
+    }
+    g = w * 64 + 63 - __builtin_clzll(bits);
+    return ranges->start_index[start_find(ranges, g)];
+}
+
+/*
+ * start_after - Index of the live block starting closest above
+ *     granule g, or -1 if there is none
+ */
+static int start_after(const range_set_t *ranges, size_t g) {
+    size_t w;
+    uint64_t bits;
+
+    g++;
+    w = GRANULE_WORD(g);
+    if (w >= ranges->nwords)
+        return -1;
+    bits = ranges->starts[w] & ~(GRANULE_BIT(g) - 1);
+    while (bits == 0) {
+        if (++w >= ranges->nwords)
+            return -1;
+        bits = ranges->starts[w];
+    }
+    g = w * 64 + __builtin_ctzll(bits);
+    return ranges->start_index[start_find(ranges, g)];
+}
+
+/*
+ * shadow_cover - Make sure the bitmap covers granules up to ghi,
+ *     growing it if the heap has grown.
+ */
+static void shadow_cover(range_set_t *ranges, size_t ghi) {
+    size_t need = GRANULE_WORD(ghi) + 1;
+    size_t nwords = ranges->nwords ? ranges->nwords : 1024;
+
+    if (need <= ranges->nwords)
+        return;
+    while (nwords < need)
+        nwords *= 2;
+    ranges->shadow = realloc(ranges->shadow, nwords * sizeof(uint64_t));
+    ranges->starts = realloc(ranges->starts, nwords * sizeof(uint64_t));
+    if (ranges->shadow == NULL || ranges->starts == NULL)
+        unix_error("realloc error in shadow_cover");
+    memset(ranges->shadow + ranges->nwords, 0,
+           (nwords - ranges->nwords) * sizeof(uint64_t));
+    memset(ranges->starts + ranges->nwords, 0,
+           (nwords - ranges->nwords) * sizeof(uint64_t));
+    ranges->nwords = nwords;
+}
+
+/*
+ * shadow_update - Set (set = true) or clear the bits for granules
+ *     [glo, ghi].  When setting, returns the first granule that was
+ *     already set, or -1 if none was; the bits are only changed if
+ *     none was.
+ */
+static long shadow_update(range_set_t *ranges, size_t glo, size_t ghi,
+                          bool set) {
+    size_t wlo = GRANULE_WORD(glo), whi = GRANULE_WORD(ghi), w;
+    uint64_t lo_mask = ~(GRANULE_BIT(glo) - 1);
+    uint64_t hi_mask = (GRANULE_BIT(ghi) - 1) | GRANULE_BIT(ghi);
+    uint64_t *shadow = ranges->shadow;
+
+    if (set) {
+        /* Check the whole range first, a word at a time */
+        for (w = wlo; w <= whi; w++) {
+            uint64_t mask = ~(uint64_t) 0;
+            if (w == wlo)
+                mask &= lo_mask;
+            if (w == whi)
+                mask &= hi_mask;
+            if (shadow[w] & mask)
+                return (long) (w * 64 + __builtin_ctzll(shadow[w] & mask));
+        }
+    }
+    if (wlo == whi) {
+        if (set)
+            shadow[wlo] |= lo_mask & hi_mask;
+        else
+            shadow[wlo] &= ~(lo_mask & hi_mask);
+        return -1;
+    }
+    if (set) {
+        shadow[wlo] |= lo_mask;
+        shadow[whi] |= hi_mask;
+    } else {
+        shadow[wlo] &= ~lo_mask;
+        shadow[whi] &= ~hi_mask;
+    }
+    if (whi > wlo + 1)
+        memset(&shadow[wlo + 1], set ? 0xff : 0,
+               (whi - wlo - 1) * sizeof(uint64_t));
+    return -1;
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list.
+ *     we mark its granules in the shadow bitmap and add it to the
+ *     live set.
  */
 static bool add_range(range_set_t *ranges, char *lo, size_t size,
                       const trace_t *trace, int opnum, int index) {
@@ -693,81 +1624,98 @@ static bool add_range(range_set_t *ranges, char *lo, size_t size,
     }
 
     /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    if ((lo < (char *)mm->heap_lo()) || (lo > (char *)mm->heap_hi()) ||
+        (hi < (char *)mm->heap_lo()) || (hi > (char *)mm->heap_hi())) {
         malloc_error(trace, opnum,
                      "Payload (%p:%p) lies outside heap (%p:%p)",
-                     lo, hi, mem_heap_lo(), mem_heap_hi());
+                     lo, hi, mm->heap_lo(), mm->heap_hi());
         return false;
     }
 
-    /* If we can't afford the linear-time loop, we check less thoroughly and
+    /* If we can't afford the bitmap, we check less thoroughly and
        just assume the overlap will be caught by writing random bits. */
     if (debug_mode == DBG_NONE) return 1;
 
-    /* Look in the tree for the predecessor block */
-    range_t *prev = tree_find_nearest(ranges->lo_tree, (long unsigned) lo);
-    range_t *next = prev ? prev->next : NULL;
-    /* See if it overlaps previous or next blocks */
-    if (prev && lo <= prev->hi) {
-        malloc_error(trace, opnum,
-                     "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-                     lo, hi, prev->lo, prev->hi);
-        return false;
-    }
-    if (next && hi >= next->lo) {
+    if (ranges->base == NULL)
+        ranges->base = (char *) mm->heap_lo() -
+            ((unsigned long) mm->heap_lo() % ALIGNMENT);
+    size_t glo = (lo - ranges->base) / ALIGNMENT;
+    size_t ghi = (hi - ranges->base) / ALIGNMENT;
+    shadow_cover(ranges, ghi);
+
+    /* See if it overlaps any other block */
+    long hit = shadow_update(ranges, glo, ghi, true);
+    if (hit >= 0) {
+        /* Slow path: find the block that owns the granule */
+        char *ghit = ranges->base + (size_t) hit * ALIGNMENT;
+        int k;
+        for (k = 0; k < ranges->num_live; k++) {
+            char *olo = trace->blocks[ranges->live[k]];
+            char *ohi = olo + trace->block_sizes[ranges->live[k]] - 1;
+            if (olo < ghit + ALIGNMENT && ohi >= ghit) {
+                malloc_error(trace, opnum,
+                             "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+                             lo, hi, olo, ohi);
+                return false;
+            }
+        }
         malloc_error(trace, opnum,
-                     "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-                     lo, hi, next->lo, next->hi);
+                     "Payload (%p:%p) overlaps another payload\n", lo, hi);
         return false;
     }
-    /*
-     * Everything looks OK, so remember the extent of this block
-     * by creating a range struct and adding it the range list.
-     */
-    range_t *p;
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-        unix_error("malloc error in add_range");
-    p->prev = prev;
-    if (prev)
-        prev->next = p;
-    else
-        ranges->list = p;
-    p->next = next;
-    if (next)
-        next->prev = p;
-    p->lo = lo;
-    p->hi = hi;
-    p->index = index;
-    tree_insert(ranges->lo_tree, (long unsigned) lo, (void *) p);
+
+    /* Everything looks OK, so remember this block as live */
+    start_insert(ranges, glo, index);
+    ranges->live_pos[index] = ranges->num_live;
+    ranges->live[ranges->num_live++] = index;
     return true;
 }
 
 /*
- * remove_range - Free the range record of block whose payload starts at lo
+ * remove_range - Forget the payload of block index, whose extent is
+ *     still recorded in trace->blocks and trace->block_sizes
  */
-static void remove_range(range_set_t *ranges, char *lo)
+static void remove_range(range_set_t *ranges, const trace_t *trace, int index)
 {
-    range_t *p = (range_t *) tree_remove(ranges->lo_tree, (long unsigned) lo);
-    if (!p)
+    int pos = ranges->live_pos[index];
+    char *lo = trace->blocks[index];
+    size_t glo;
+
+    if (pos < 0)
         return;
-    range_t *prev = p->prev;
-    range_t *next = p->next;
-    if (prev)
-        prev->next = next;
-    else
-        ranges->list = next;
-    if (next)
-        next->prev = prev;
-    free(p);
+    glo = (lo - ranges->base) / ALIGNMENT;
+    shadow_update(ranges, glo,
+                  (lo + trace->block_sizes[index] - 1 - ranges->base) / ALIGNMENT,
+                  false);
+    start_remove(ranges, glo);
+
+    /* Move the last live index into the vacated slot */
+    ranges->live[pos] = ranges->live[--ranges->num_live];
+    ranges->live_pos[ranges->live[pos]] = pos;
+    ranges->live_pos[index] = -1;
+}
+
+/*
+ * clear_range_set - Forget every live block, e.g. those a trace never
+ *     freed, before the trace is run again
+ */
+static void clear_range_set(range_set_t *ranges, const trace_t *trace)
+{
+    while (ranges->num_live > 0)
+        remove_range(ranges, trace, ranges->live[ranges->num_live - 1]);
 }
 
 /*
- * free_range_set - free all of the range records for a trace
+ * free_range_set - free the range set of a trace
  */
 static void free_range_set(range_set_t *ranges)
 {
-    tree_free(ranges->lo_tree, free);
+    free(ranges->shadow);
+    free(ranges->starts);
+    free(ranges->start_keys);
+    free(ranges->start_index);
+    free(ranges->live);
+    free(ranges->live_pos);
     free(ranges);
 }
 
@@ -784,11 +1732,29 @@ static void init_random_data(void) {
     for(len = 0; len < RANDOM_DATA_LEN; ++len) {
         random_data[len] = random();
     }
+    memcpy(&random_data[RANDOM_DATA_LEN], random_data, MAXFILL);
+}
+
+/*
+ * fill_pattern - the random data expected at byte offset off of a block
+ *     with random base base; valid for up to maxfill bytes
+ */
+static const randint_t *fill_pattern(int base, size_t off) {
+    return &random_data[(base + off) % RANDOM_DATA_LEN];
+}
+
+/*
+ * fill_extent - the regions of a block of size bytes that get random
+ *     data: the head [0, *head_len) and the tail [*tail_off, size),
+ *     which is empty when the head already covers the whole block.
+ */
+static void fill_extent(size_t size, size_t *head_len, size_t *tail_off) {
+    *head_len = size < maxfill ? size : maxfill;
+    *tail_off = size > 2 * maxfill ? size - maxfill : *head_len;
 }
 
 static void randomize_block(trace_t *traces, int index) {
-    size_t size, fsize;
-    size_t i;
+    size_t size, head_len, tail_off;
     randint_t *block;
     int base;
 
@@ -800,60 +1766,94 @@ static void randomize_block(trace_t *traces, int index) {
     size = traces->block_sizes[index] / sizeof(*block);
     if (size == 0)
         return;
-    fsize = size;
-    if (fsize > maxfill)
-        fsize = maxfill;
     base = traces->block_rand_base[index];
 
-    // NOTE: It's expensive to do this one byte at a time.
-
-    // NOTE: It would be nice to also fill in at end of block, but
-    // this gets messy with REALLOC
-
-    for(i = 0; i < fsize; i++) {
-        mem_write(&block[i],
-                  random_data[(base + i) % RANDOM_DATA_LEN],
-                  sizeof(randint_t));
-    }
+    fill_extent(size, &head_len, &tail_off);
+    memcpy(block, fill_pattern(base, 0), head_len);
+    if (tail_off < size)
+        memcpy(&block[tail_off], fill_pattern(base, tail_off), size - tail_off);
 }
 
-static bool check_index(const trace_t *trace, int opnum, int index) {
-    size_t size, fsize;
+/*
+ * check_region - verify len bytes at byte offset off of block index,
+ *     comparing whole vectors first and counting garbled bytes only
+ *     when they differ.
+ */
+static bool check_region(const trace_t *trace, int opnum, int index,
+                         size_t off, size_t len) {
+    const randint_t *block = (randint_t *) trace->blocks[index] + off;
+    const randint_t *expect = fill_pattern(trace->block_rand_base[index], off);
     size_t i;
-    randint_t *block;
-    int base;
     int ngarbled = 0;
-    int firstgarbled = -1;
+    long firstgarbled = -1;
 
-    if (index < 0) return true; /* we're doing free(NULL) */
-    if (debug_mode == DBG_NONE) return true;
-
-    block = (randint_t*)trace->blocks[index];
-    size = trace->block_sizes[index] / sizeof(*block);
-    if (size == 0)
+    if (len == 0 || memcmp(block, expect, len) == 0)
         return true;
-    fsize = size;
 
-    size_t thresh = maxfill;
-    if (fsize > thresh)
-        fsize = thresh;
-
-    base = trace->block_rand_base[index];
-
-    // NOTE: It's expensive to do this one byte at a time.
-    for(i = 0; i < fsize; i++) {
-        if (mem_read(&block[i], sizeof(randint_t)) != random_data[(base + i) % RANDOM_DATA_LEN]) {
+    for (i = 0; i < len; i++) {
+        if (block[i] != expect[i]) {
             if (firstgarbled == -1) firstgarbled = i;
             ngarbled++;
         }
     }
-    if (ngarbled != 0) {
-        malloc_error(trace, opnum, "block %d (at %p) has %d garbled %s%s, "
-                     "starting at byte %zu", index, &block[firstgarbled], ngarbled, randint_t_name,
-                     (ngarbled > 1 ? "s" : ""), sizeof(randint_t) * firstgarbled);
-        return false;
-    }
-    return true;
+    malloc_error(trace, opnum, "block %d (at %p) has %d garbled %s%s, "
+                 "starting at byte %zu", index, &block[firstgarbled], ngarbled,
+                 randint_t_name, (ngarbled > 1 ? "s" : ""),
+                 sizeof(randint_t) * (off + firstgarbled));
+    return false;
+}
+
+/*
+ * check_block - verify the random data of block index, which was filled
+ *     when it was filled bytes long, in its first limit bytes (less than
+ *     filled after a shrinking realloc).
+ */
+static bool check_block(const trace_t *trace, int opnum, int index,
+                        size_t filled, size_t limit) {
+    size_t head_len, tail_off;
+    bool ok;
+
+    if (index < 0) return true; /* we're doing free(NULL) */
+    if (debug_mode == DBG_NONE) return true;
+
+    filled /= sizeof(randint_t);
+    limit /= sizeof(randint_t);
+    if (limit > filled)
+        limit = filled;
+    if (limit == 0)
+        return true;
+
+    fill_extent(filled, &head_len, &tail_off);
+    ok = check_region(trace, opnum, index, 0,
+                      head_len < limit ? head_len : limit);
+    if (tail_off < limit)
+        ok = check_region(trace, opnum, index, tail_off, limit - tail_off) && ok;
+    return ok;
+}
+
+static bool check_index(const trace_t *trace, int opnum, int index) {
+    if (index < 0) return true; /* we're doing free(NULL) */
+    return check_block(trace, opnum, index, trace->block_sizes[index],
+                       trace->block_sizes[index]);
+}
+
+/*
+ * check_neighbours - Check the live blocks on either side of the size
+ *     bytes at lo, which an operation just allocated or released.  An
+ *     allocator that writes past a block's boundary tags or coalesces
+ *     incorrectly usually damages these first.
+ */
+static bool check_neighbours(const trace_t *trace, const range_set_t *ranges,
+                             int opnum, const char *lo, size_t size) {
+    size_t glo, ghi;
+    bool ok = true;
+
+    if (ranges->base == NULL || lo == NULL || size == 0)
+        return true;
+    glo = (lo - ranges->base) / ALIGNMENT;
+    ghi = (lo + size - 1 - ranges->base) / ALIGNMENT;
+    ok = check_index(trace, opnum, start_before(ranges, glo));
+    return check_index(trace, opnum, start_after(ranges, ghi)) && ok;
 }
 
 /**********************************************
@@ -872,7 +1872,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     int index;
     size_t size;
     int max_index = 0;
-    int op_index;
+    int op_num;
     int ignore = 0;
 
     if (verbose > 1)
@@ -903,6 +1903,8 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     if ((trace->ops =
          (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
         unix_error("malloc 2 failed in read_trace");
+    trace->escapes = NULL;
+    trace->num_escapes = 0;
 
     /* We'll keep an array of pointers to the allocated blocks here... */
     if ((trace->blocks =
@@ -922,38 +1924,33 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 
     /* read every request line in the trace file */
     index = 0;
-    op_index = 0;
+    op_num = 0;
     while (fscanf(tracefile, "%s", type) != EOF) {
         switch(type[0]) {
         case 'a':
             ignore += fscanf(tracefile, "%u %lu", &index, &size);
-            trace->ops[op_index].type = ALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
+            pack_op(trace, op_num, ALLOC, index, size);
             max_index = (index > max_index) ? index : max_index;
             break;
         case 'r':
             ignore += fscanf(tracefile, "%u %lu", &index, &size);
-            trace->ops[op_index].type = REALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
+            pack_op(trace, op_num, REALLOC, index, size);
             max_index = (index > max_index) ? index : max_index;
             break;
         case 'f':
             ignore += fscanf(tracefile, "%u", &index);
-            trace->ops[op_index].type = FREE;
-            trace->ops[op_index].index = index;
+            pack_op(trace, op_num, FREE, index, 0);
             break;
         default:
             app_error("Bogus type character (%c) in tracefile %s\n",
                       type[0], trace->filename);
         }
-        op_index++;
-        if (op_index == trace->num_ops) break;
+        op_num++;
+        if (op_num == trace->num_ops) break;
     }
     fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
+    assert(trace->num_ops == op_num);
 
     /* fill in the stats */
     strcpy(stats->filename, trace->filename);
@@ -963,6 +1960,35 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     return trace;
 }
 
+/*
+ * pack_op - Store request i of trace, escaping its index and size if
+ *     they do not fit.  Requests must be stored in order.
+ */
+static void pack_op(trace_t *trace, int i, optype_t type, long index,
+                    size_t size)
+{
+    uint64_t packed_index = index < 0 ? OP_INDEX_NONE : (uint64_t) index;
+
+    if (index >= (long) OP_INDEX_NONE || (uint64_t) size >= OP_SIZE_ESCAPE) {
+        /* Grow the table by doubling whenever its size is a power of 2 */
+        int n = trace->num_escapes;
+        if ((n & (n - 1)) == 0) {
+            trace->escapes = realloc(trace->escapes,
+                                     (n ? 2 * n : 1) * sizeof(op_escape_t));
+            if (trace->escapes == NULL)
+                unix_error("realloc failed in pack_op");
+        }
+        trace->escapes[n].opnum = i;
+        trace->escapes[n].index = index;
+        trace->escapes[n].size = size;
+        trace->num_escapes++;
+        packed_index = 0;
+        size = OP_SIZE_ESCAPE;
+    }
+    trace->ops[i] = (traceop_t) type | (packed_index << OP_TYPE_BITS) |
+        ((uint64_t) size << 32);
+}
+
 /*
  * reinit_trace - get the trace ready for another run.
  */
@@ -974,12 +2000,13 @@ static void reinit_trace(trace_t *trace)
 }
 
 /*
- * free_trace - Free the trace record and the four arrays it points
+ * free_trace - Free the trace record and the arrays it points
  *              to, all of which were allocated in read_trace().
  */
 static void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    free(trace->ops);         /* free the arrays... */
+    free(trace->escapes);
     free(trace->blocks);
     free(trace->block_sizes);
     free(trace->block_rand_base);
@@ -1002,56 +2029,63 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
     char *newp;
     char *oldp;
     char *p;
+    const char *touched[2];     /* extents this op allocated or released */
+    size_t touched_size[2];
+    int ntouched;
     bool allCheck = true;
 
-    /* Reset the heap and free any records in the range list */
+    /* Reset the heap and forget any blocks left over from a previous run */
+    clear_range_set(ranges, trace);
     mem_reset_brk();
     reinit_trace(trace);
 
     /* Call the mm package's init function */
-    if (!mm_init()) {
+    if (!mm->init()) {
         malloc_error(trace, 0, "mm_init failed.");
         return false;
     }
 
     /* Interpret each operation in the trace in order */
     for (i = 0;  i < trace->num_ops;  i++) {
-        index = trace->ops[i].index;
-        size = trace->ops[i].size;
+        index = op_index(trace, i);
+        size = op_size(trace, i);
+        ntouched = 0;
 
         if (debug_mode == DBG_EXPENSIVE) {
-            range_t *r;
+            int k;
 
             /* Let the students check their own heap */
-            if (!mm_checkheap(0)) {
+            if (!mm->checkheap(0)) {
                 malloc_error(trace, i, "mm_checkheap returned false\n");
                 return false;
             };
 
-            /* Now check that all our allocated blocks have the right data */
-            r = ranges->list;
-            while (r) {
-                if (!check_index(trace, i, r->index))
-                {
-                    allCheck = false;
+            /* Periodically check that all our allocated blocks have the
+               right data; in between, only the blocks next to the ones
+               each op touched are checked (below) */
+            if (i % sweep_interval == 0) {
+                for (k = 0; k < ranges->num_live; k++) {
+                    if (!check_index(trace, i, ranges->live[k]))
+                    {
+                        allCheck = false;
+                    }
                 }
-                r = r->next;
             }
         }
 
-        switch (trace->ops[i].type) {
+        switch (op_type(trace, i)) {
 
         case ALLOC: /* mm_malloc */
 
             /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
+            if ((p = mm->malloc(size)) == NULL) {
                 malloc_error(trace, i, "mm_malloc failed.");
                 return false;
             }
 
             /*
              * Test the range of the new block for correctness and add it
-             * to the range list if OK. The block must be  be aligned properly,
+             * to the range set if OK. The block must be  be aligned properly,
              * and must not overlap any currently allocated block.
              */
             if (add_range(ranges, p, size, trace, i, index) == 0)
@@ -1060,6 +2094,8 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
             /* Remember region */
             trace->blocks[index] = p;
             trace->block_sizes[index] = size;
+            touched[ntouched] = p;
+            touched_size[ntouched++] = size;
 
             /* Set to random data, for debugging. */
             randomize_block(trace, index);
@@ -1073,7 +2109,9 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
 
             /* Call the student's realloc */
             oldp = trace->blocks[index];
-            newp = mm_realloc(oldp, size);
+            touched[ntouched] = oldp;
+            touched_size[ntouched++] = trace->block_sizes[index];
+            newp = mm->realloc(oldp, size);
             if ( (newp == NULL) && (size != 0) ) {
                 malloc_error(trace, i, "mm_realloc failed.");
                 return false;
@@ -1084,10 +2122,10 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
                 return false;
             }
 
-            /* Remove the old region from the range list */
-            remove_range(ranges, oldp);
+            /* Remove the old region from the range set */
+            remove_range(ranges, trace, index);
 
-            /* Check new block for correctness and add it to range list */
+            /* Check new block for correctness and add it to range set */
             if (size > 0) {
                 if (add_range(ranges, newp, size, trace, i, index) == 0)
                     return false;
@@ -1097,16 +2135,13 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
             /* Move the region from where it was.
              * Check up to min(size, oldsize) for correct copying. */
             trace->blocks[index] = newp;
-            if (size < trace->block_sizes[index]) {
-                trace->block_sizes[index] = size;
-            }
-            // NOTE: Might help to pass old size here to check bytes at each end of allocation
-
-            if (!check_index(trace, i, index))
+            if (!check_block(trace, i, index, trace->block_sizes[index], size))
             {
                 allCheck = false;
             }
             trace->block_sizes[index] = size;
+            touched[ntouched] = newp;
+            touched_size[ntouched++] = size;
 
             /* Set to random data, for debugging. */
             randomize_block(trace, index);
@@ -1123,14 +2158,38 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
                 p = 0;
             } else {
                 p = trace->blocks[index];
-                remove_range(ranges, p);
+                touched[ntouched] = p;
+                touched_size[ntouched++] = trace->block_sizes[index];
+                remove_range(ranges, trace, index);
             }
-            mm_free(p);
+            mm->free(p);
             break;
 
         default:
             app_error("Nonexistent request type in eval_mm_valid");
         }
+
+        if (debug_mode == DBG_EXPENSIVE) {
+            int k;
+            for (k = 0; k < ntouched; k++) {
+                if (!check_neighbours(trace, ranges, i, touched[k],
+                                      touched_size[k]))
+                {
+                    allCheck = false;
+                }
+            }
+        }
+    }
+
+    /* Catch anything the last partial sweep period missed */
+    if (debug_mode == DBG_EXPENSIVE) {
+        int k;
+        for (k = 0; k < ranges->num_live; k++) {
+            if (!check_index(trace, trace->num_ops, ranges->live[k]))
+            {
+                allCheck = false;
+            }
+        }
     }
     /* As far as we know, this is a valid malloc package */
     return allCheck;
@@ -1147,32 +2206,49 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
  *   is always the high water mark of the heap.
  *
  *   A higher number is better: 1 is optimal.
+ *
+ *   No allocator can reach 1, though, since two payloads never start
+ *   in the same ALIGNMENT-byte granule.  The peak of live blocks
+ *   rounded up to whole granules is a lower bound on any aligned
+ *   allocator's heap, and is recorded with the heap size in stats for
+ *   --bound to report the gap between them.
  */
-static double eval_mm_util(trace_t *trace, int tracenum)
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats)
 {
     int i;
     int index;
     size_t size, newsize, oldsize;
     size_t max_total_size = 0;
     size_t total_size = 0;
+    size_t max_aligned_size = 0;
+    size_t aligned_size = 0;
     char *p;
     char *newp, *oldp;
 
+    bool timeline = frag_interval > 0 && mm->freeinfo;
+    timeline_t tl;
+    bool dump_prof = heap_profile && mm->prof_dump;
+    bool dump_map = heap_map && mm->heap_dump;
+    int dump_op = dump_prof || dump_map ? peak_op(trace) : -1;
+
     reinit_trace(trace);
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (!mm_init())
+    if (!mm->init())
         app_error("trace %d: mm_init failed in eval_mm_util", tracenum);
+    /* Only now does freeinfo describe this trace's heap */
+    if (timeline)
+        open_timeline(trace, &tl);
 
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+        switch (op_type(trace, i)) {
 
         case ALLOC: /* mm_alloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
+            index = op_index(trace, i);
+            size = op_size(trace, i);
 
-            if ((p = mm_malloc(size)) == NULL) {
+            if ((p = mm->malloc(size)) == NULL) {
                 app_error("trace %d: mm_malloc failed in eval_mm_util",
                           tracenum);
             }
@@ -1182,15 +2258,16 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             trace->block_sizes[index] = size;
 
             total_size += size;
+            aligned_size += ALIGN_UP(size);
             break;
 
         case REALLOC: /* mm_realloc */
-            index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
+            index = op_index(trace, i);
+            newsize = op_size(trace, i);
             oldsize = trace->block_sizes[index];
 
             oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0) {
+            if ((newp = mm->realloc(oldp,newsize)) == NULL && newsize != 0) {
                 app_error("trace %d: mm_realloc failed in eval_mm_util",
                           tracenum);
             }
@@ -1200,10 +2277,11 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             trace->block_sizes[index] = newsize;
 
             total_size += (newsize - oldsize);
+            aligned_size += ALIGN_UP(newsize) - ALIGN_UP(oldsize);
             break;
 
         case FREE: /* mm_free */
-            index = trace->ops[i].index;
+            index = op_index(trace, i);
             if (index < 0) {
                 size = 0;
                 p = 0;
@@ -1212,9 +2290,10 @@ static double eval_mm_util(trace_t *trace, int tracenum)
                 p = trace->blocks[index];
             }
 
-            mm_free(p);
+            mm->free(p);
 
             total_size -= size;
+            aligned_size -= ALIGN_UP(size);
             break;
 
         default:
@@ -1225,16 +2304,233 @@ static double eval_mm_util(trace_t *trace, int tracenum)
         /* update the high-water mark */
         max_total_size = (total_size > max_total_size) ?
             total_size : max_total_size;
+        max_aligned_size = (aligned_size > max_aligned_size) ?
+            aligned_size : max_aligned_size;
+
+        if (timeline && (i % frag_interval == 0 || i == trace->num_ops - 1))
+            sample_timeline(&tl, i, total_size);
+        if (i == dump_op && dump_prof)
+            dump_profile(trace);
+        if (i == dump_op && dump_map)
+            dump_heap_map(trace);
     }
 
+    if (timeline)
+        close_timeline(&tl);
+    if (event_trace && mm->trace_dump)
+        dump_events(trace);
+
 #if !REF_ONLY
     printf(".");
 #endif
 
+    if (mm->stats) {
+        mm->stats(&stats->mm);
+        stats->mm_valid = true;
+    }
+    if (cycles_mode && mm->cycles)
+        stats->cycles_valid = mm->cycles(&stats->cycles) == 0;
+    stats->heap_bytes = mem_heapsize();
+    stats->peak_bytes = max_total_size;
+    stats->bound_bytes = max_aligned_size;
     return ((double)max_total_size / (double)mem_heapsize());
 }
 
 
+/*
+ * output_name - Name a per-trace output file after the trace file
+ *     (traces/bdd-aa4.rep -> bdd-aa4<suffix>), in the current directory.
+ *     Allocators loaded with -a get their name added before the suffix.
+ */
+static void output_name(const trace_t *trace, const char *suffix, char *name)
+{
+    const char *base = strrchr(trace->filename, '/');
+    char *dot;
+
+    strcpy(name, base ? base + 1 : trace->filename);
+    if ((dot = strrchr(name, '.')) != NULL)
+        *dot = '\0';
+    /* Keep the outputs of allocators loaded with -a apart */
+    if (mm != &mm_builtin_ops) {
+        strcat(name, ".");
+        strcat(name, mm->name);
+    }
+    strcat(name, suffix);
+}
+
+/*
+ * open_timeline - Create the fragmentation timeline for a trace,
+ *     <trace>.frag.csv and <trace>.frag.json, and write their headers.
+ */
+static void open_timeline(const trace_t *trace, timeline_t *tl)
+{
+    char name[MAXLINE];
+    mm_freeinfo_t info;
+    int b;
+
+    output_name(trace, ".frag.csv", name);
+    if ((tl->csv = fopen(name, "w")) == NULL)
+        unix_error("Could not create fragmentation timeline %s", name);
+    output_name(trace, ".frag.json", name);
+    if ((tl->json = fopen(name, "w")) == NULL)
+        unix_error("Could not create fragmentation timeline %s", name);
+    tl->samples = 0;
+
+    /* The bin columns are named after the largest size each bin holds */
+    mm->freeinfo(&info);
+    fprintf(tl->csv, "op,live_bytes,heap_bytes,free_bytes,free_blocks,"
+            "largest_free,ext_frag");
+    for (b = 0; b < info.nbins; b++) {
+        if (info.bin_limit[b] == 0)
+            fprintf(tl->csv, ",bin%d_rest", b);
+        else
+            fprintf(tl->csv, ",bin%d_le%zu", b, info.bin_limit[b]);
+    }
+    fprintf(tl->csv, "\n");
+
+    /* The same, with 0 for the last bin's missing limit */
+    fprintf(tl->json, "{\"trace\": ");
+    json_write_string(tl->json, trace->filename);
+    fprintf(tl->json, ", \"interval\": %d, \"bin_limits\": [", frag_interval);
+    for (b = 0; b < info.nbins; b++)
+        fprintf(tl->json, "%s%zu", b ? ", " : "", info.bin_limit[b]);
+    fprintf(tl->json, "],\n \"samples\": [");
+}
+
+/*
+ * close_timeline - Finish the JSON timeline and close both files
+ */
+static void close_timeline(timeline_t *tl)
+{
+    fprintf(tl->json, "\n]}\n");
+    fclose(tl->json);
+    fclose(tl->csv);
+}
+
+/*
+ * sample_timeline - Append one sample to the fragmentation timeline:
+ *     live payload, heap size, free space per bin and external
+ *     fragmentation (1 - largest free block / total free bytes).
+ */
+static void sample_timeline(timeline_t *tl, int opnum, size_t live_bytes)
+{
+    mm_freeinfo_t info;
+    size_t free_bytes = 0, free_blocks = 0;
+    double ext_frag;
+    int b;
+
+    mm->freeinfo(&info);
+    for (b = 0; b < info.nbins; b++) {
+        free_bytes += info.free_bytes[b];
+        free_blocks += info.free_blocks[b];
+    }
+    ext_frag = free_bytes ? 1.0 - (double) info.largest_free / free_bytes : 0.0;
+
+    fprintf(tl->csv, "%d,%zu,%zu,%zu,%zu,%zu,%.4f", opnum, live_bytes,
+            mem_heapsize(), free_bytes, free_blocks, info.largest_free,
+            ext_frag);
+    for (b = 0; b < info.nbins; b++)
+        fprintf(tl->csv, ",%zu", info.free_bytes[b]);
+    fprintf(tl->csv, "\n");
+
+    fprintf(tl->json, "%s\n  {\"op\": %d, \"live_bytes\": %zu, "
+            "\"heap_bytes\": %zu, \"free_bytes\": %zu, \"free_blocks\": %zu, "
+            "\"largest_free\": %zu, \"ext_frag\": %.4f, \"bins\": [",
+            tl->samples ? "," : "", opnum, live_bytes, mem_heapsize(),
+            free_bytes, free_blocks, info.largest_free, ext_frag);
+    for (b = 0; b < info.nbins; b++)
+        fprintf(tl->json, "%s%zu", b ? ", " : "", info.free_bytes[b]);
+    fprintf(tl->json, "]}");
+    tl->samples++;
+}
+
+/*
+ * peak_op - The first request after which the trace's live payload is
+ *     at its peak, where heap profiles and maps show the most
+ */
+static int peak_op(const trace_t *trace)
+{
+    size_t *sizes = calloc(trace->num_ids + 1, sizeof(size_t));
+    size_t live = 0, peak = 0;
+    long index;
+    int i, op = trace->num_ops - 1;
+
+    if (sizes == NULL)
+        unix_error("calloc failed in peak_op");
+    for (i = 0; i < trace->num_ops; i++) {
+        index = op_index(trace, i);
+        if (index < 0)
+            continue;
+        live -= sizes[index];
+        sizes[index] = op_type(trace, i) == FREE ? 0 : op_size(trace, i);
+        live += sizes[index];
+        if (live > peak) {
+            peak = live;
+            op = i;
+        }
+    }
+    free(sizes);
+    return op;
+}
+
+/*
+ * dump_profile - Write the allocator's heap profile to <trace>.heap
+ */
+static void dump_profile(const trace_t *trace)
+{
+    char name[MAXLINE];
+    int fd;
+
+    output_name(trace, ".heap", name);
+    if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        unix_error("Could not create heap profile %s", name);
+    if (mm->prof_dump(fd) < 0)
+        unix_error("Could not write heap profile %s", name);
+    close(fd);
+}
+
+/*
+ * dump_events - Write the allocator's event ring to <trace>.events,
+ *     or warn once if it was built without one
+ */
+static void dump_events(const trace_t *trace)
+{
+    static bool warned = false;
+    char name[MAXLINE];
+    int fd;
+
+    output_name(trace, ".events", name);
+    if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        unix_error("Could not create event trace %s", name);
+    if (mm->trace_dump(fd) < 0) {
+        close(fd);
+        unlink(name);
+        if (!warned)
+            fprintf(stderr, "Warning: %s has no event trace; "
+                    "rebuild with make MMTRACE=1\n", mm->name);
+        warned = true;
+        return;
+    }
+    close(fd);
+}
+
+/*
+ * dump_heap_map - Write a snapshot of the allocator's heap to
+ *     <trace>.heapmap
+ */
+static void dump_heap_map(const trace_t *trace)
+{
+    char name[MAXLINE];
+    int fd;
+
+    output_name(trace, ".heapmap", name);
+    if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        unix_error("Could not create heap map %s", name);
+    if (mm->heap_dump(fd) < 0)
+        unix_error("Could not write heap map %s", name);
+    close(fd);
+}
+
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
  *    to measure the running time of the mm malloc package.
@@ -1249,38 +2545,38 @@ static void eval_mm_speed(void *ptr)
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (!mm_init())
+    if (!mm->init())
         app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
     for (i = 0;  i < trace->num_ops;  i++)
-        switch (trace->ops[i].type) {
+        switch (op_type(trace, i)) {
 
         case ALLOC: /* mm_malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            index = op_index(trace, i);
+            size = op_size(trace, i);
+            if ((p = mm->malloc(size)) == NULL)
                 app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
 
         case REALLOC: /* mm_realloc */
-            index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
+            index = op_index(trace, i);
+            newsize = op_size(trace, i);
             oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
+            if ((newp = mm->realloc(oldp,newsize)) == NULL && newsize != 0)
                 app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
 
         case FREE: /* mm_free */
-            index = trace->ops[i].index;
+            index = op_index(trace, i);
             if (index < 0) {
                 block = 0;
             } else {
                 block = trace->blocks[index];
             }
-            mm_free(block);
+            mm->free(block);
             break;
 
         default:
@@ -1288,6 +2584,86 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * eval_mm_latency - Replay the trace once, timestamping every request
+ *    with the fenced tick counter, and record the per-op latency
+ *    percentiles in stats, converted to ns when the tick rate is known.
+ *    Run separately from eval_mm_speed so the timestamps never inflate
+ *    the throughput numbers.
+ */
+static void eval_mm_latency(trace_t *trace, stats_t *stats)
+{
+    static hist_t hists[NUM_LAT_OPS];
+    int i, j, index;
+    size_t size, newsize;
+    char *p, *newp, *oldp, *block;
+    uint64_t start, ticks;
+    lat_op_t op = LAT_ALL;
+
+    for (j = 0; j < NUM_LAT_OPS; j++)
+        hist_reset(&hists[j]);
+    reinit_trace(trace);
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (!mm->init())
+        app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        switch (op_type(trace, i)) {
+
+        case ALLOC: /* mm_malloc */
+            index = op_index(trace, i);
+            size = op_size(trace, i);
+            start = ticks_begin();
+            p = mm->malloc(size);
+            ticks = ticks_end() - start;
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            op = LAT_MALLOC;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            index = op_index(trace, i);
+            newsize = op_size(trace, i);
+            oldp = trace->blocks[index];
+            start = ticks_begin();
+            newp = mm->realloc(oldp, newsize);
+            ticks = ticks_end() - start;
+            if (newp == NULL && newsize != 0)
+                app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = newp;
+            op = LAT_REALLOC;
+            break;
+
+        case FREE: /* mm_free */
+            index = op_index(trace, i);
+            block = index < 0 ? 0 : trace->blocks[index];
+            start = ticks_begin();
+            mm->free(block);
+            ticks = ticks_end() - start;
+            op = LAT_FREE;
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_latency");
+        }
+        hist_record(&hists[op], ticks);
+        hist_record(&hists[LAT_ALL], ticks);
+    }
+
+    double scale = ticks_ns();
+    for (j = 0; j < NUM_LAT_OPS; j++) {
+        int k;
+        for (k = 0; k < NUM_LAT_PCTS; k++)
+            stats->lat[j][k] = (double) hist_percentile(&hists[j], lat_pcts[k]) *
+                (scale > 0.0 ? scale : 1.0);
+    }
+    stats->lat_valid = true;
+    stats->lat_ns = scale > 0.0;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1303,29 +2679,29 @@ static bool eval_libc_valid(trace_t *trace)
     reinit_trace(trace);
 
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+        switch (op_type(trace, i)) {
 
         case ALLOC: /* malloc */
-            if ((p = malloc(trace->ops[i].size)) == NULL) {
+            if ((p = malloc(op_size(trace, i))) == NULL) {
                 malloc_error(trace, i, "libc malloc failed");
                 unix_error("System message");
             }
-            trace->blocks[trace->ops[i].index] = p;
+            trace->blocks[op_index(trace, i)] = p;
             break;
 
         case REALLOC: /* realloc */
-            newsize = trace->ops[i].size;
-            oldp = trace->blocks[trace->ops[i].index];
+            newsize = op_size(trace, i);
+            oldp = trace->blocks[op_index(trace, i)];
             if ((newp = realloc(oldp, newsize)) == NULL && newsize != 0) {
                 malloc_error(trace, i, "libc realloc failed");
                 unix_error("System message");
             }
-            trace->blocks[trace->ops[i].index] = newp;
+            trace->blocks[op_index(trace, i)] = newp;
             break;
 
         case FREE: /* free */
-            if (trace->ops[i].index >= 0) {
-                free(trace->blocks[trace->ops[i].index]);
+            if (op_index(trace, i) >= 0) {
+                free(trace->blocks[op_index(trace, i)]);
             } else {
                 free(0);
             }
@@ -1355,18 +2731,18 @@ static void eval_libc_speed(void *ptr)
     reinit_trace(trace);
 
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+        switch (op_type(trace, i)) {
         case ALLOC: /* malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
+            index = op_index(trace, i);
+            size = op_size(trace, i);
             if ((p = malloc(size)) == NULL)
                 unix_error("malloc failed in eval_libc_speed");
             trace->blocks[index] = p;
             break;
 
         case REALLOC: /* realloc */
-            index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
+            index = op_index(trace, i);
+            newsize = op_size(trace, i);
             oldp = trace->blocks[index];
             if ((newp = realloc(oldp, newsize)) == NULL && newsize != 0)
                 unix_error("realloc failed in eval_libc_speed\n");
@@ -1375,7 +2751,7 @@ static void eval_libc_speed(void *ptr)
             break;
 
         case FREE: /* free */
-            index = trace->ops[i].index;
+            index = op_index(trace, i);
             if (index >= 0) {
                 block = trace->blocks[index];
                 free(block);
@@ -1398,7 +2774,7 @@ static void eval_libc_speed(void *ptr)
  */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
 {
-    int i;
+    int i, j;
 
     /* weighted sums all */
     double sumsecs = 0;
@@ -1413,10 +2789,18 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
 
     /* Print the individual results for each trace */
     if (tab_mode) {
-        printf("valid\tthru?\tutil?\tutil\tops\tmsecs\tKops\ttrace\n");
+        printf("valid\tthru?\tutil?\tutil\tops\tmsecs\tKops\t");
+        if (latency_mode)
+            for (j = 0; j < NUM_LAT_PCTS; j++)
+                printf("%s\t", lat_pct_names[j]);
+        printf("trace\n");
     } else {
-        printf("  %5s  %6s %7s%8s%8s  %s\n",
-               "valid", "util", "ops", "msecs", "Kops", "trace");
+        printf("  %5s  %6s %7s%8s%8s ",
+               "valid", "util", "ops", "msecs", "Kops");
+        if (latency_mode)
+            for (j = 0; j < NUM_LAT_PCTS; j++)
+                printf("%7s", lat_pct_names[j]);
+        printf(" %s\n", "trace");
     }
     for (i=0; i < n; i++) {
         if (stats[i].valid) {
@@ -1479,6 +2863,20 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
                     printf("%8s%10s%7s ", "--", "--", "--");
             }
 
+            /* Latency percentiles over all ops */
+            if (latency_mode) {
+                for (j = 0; j < NUM_LAT_PCTS; j++) {
+                    if (!stats[i].lat_valid)
+                        printf(tab_mode ? "\t" : "%7s", "--");
+                    else if (tab_mode)
+                        printf("%.0f\t", stats[i].lat[LAT_ALL][j]);
+                    else
+                        printf("%7.0f", stats[i].lat[LAT_ALL][j]);
+                }
+                if (!tab_mode)
+                    printf(" ");
+            }
+
             printf("%s\n", stats[i].filename);
 
             if (stats[i].weight == WALL || stats[i].weight == WPERF)
@@ -1564,6 +2962,628 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
     }
 }
 
+/*
+ * printlatency - prints the per-op latency percentiles (in ns) for
+ *                each trace, broken down by request type.
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    int i, j, k;
+
+    printf("Latency percentiles (%s) by request type:\n",
+           ticks_ns() > 0.0 ? "ns" : "ticks");
+    if (tab_mode)
+        printf("op\tp50\tp90\tp99\tp99.9\tmax\ttrace\n");
+    else
+        printf("  %-8s%8s%8s%8s%8s%8s  %s\n",
+               "op", "p50", "p90", "p99", "p99.9", "max", "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid || !stats[i].lat_valid)
+            continue;
+        for (j = 0; j < LAT_ALL; j++) {
+            /* Skip request types that never occur in this trace */
+            if (stats[i].lat[j][NUM_LAT_PCTS-1] == 0)
+                continue;
+            printf(tab_mode ? "%s\t" : "  %-8s", lat_op_names[j]);
+            for (k = 0; k < NUM_LAT_PCTS; k++)
+                printf(tab_mode ? "%.0f\t" : "%8.0f", stats[i].lat[j][k]);
+            printf(tab_mode ? "%s\n" : "  %s\n", stats[i].filename);
+        }
+    }
+}
+
+/*
+ * printperf - prints the hardware counter readings, per op, for each
+ *             trace.  Events the machine could not count print as '--'.
+ */
+static void printperf(int n, stats_t *stats)
+{
+    int i, j;
+    bool any = false;
+
+    for (i = 0; i < n; i++)
+        any = any || stats[i].perf_valid;
+    if (!any)
+        return;
+
+    printf("Hardware events per op:\n");
+    for (j = 0; j < PC_NUM; j++)
+        printf(tab_mode ? "%s\t" : "%10s", perfctr_names[j]);
+    printf(tab_mode ? "IPC\ttrace\n" : "%6s  trace\n", "IPC");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid || !stats[i].perf_valid)
+            continue;
+        for (j = 0; j < PC_NUM; j++) {
+            if (stats[i].perf[j] < 0)
+                printf(tab_mode ? "\t" : "%10s", "--");
+            else
+                printf(tab_mode ? "%.3f\t" : "%10.3f", stats[i].perf[j]);
+        }
+        if (stats[i].perf[PC_CYCLES] > 0 && stats[i].perf[PC_INSTRUCTIONS] >= 0)
+            printf(tab_mode ? "%.2f\t" : "%6.2f  ",
+                   stats[i].perf[PC_INSTRUCTIONS] / stats[i].perf[PC_CYCLES]);
+        else
+            printf(tab_mode ? "\t" : "%6s  ", "--");
+        printf("%s\n", stats[i].filename);
+    }
+    printf("\n");
+}
+
+/*
+ * printoverhead - prints the cost per op of each trace, split into the
+ *                 driver's share (the null allocator's time) and the
+ *                 allocator's, with the overall allocator-only rate
+ */
+static void printoverhead(int n, stats_t *stats)
+{
+    int i;
+    double ops = 0, alloc_secs = 0;
+
+    printf("Cost per op with driver overhead removed (ns):\n");
+    if (tab_mode)
+        printf("total\tdriver\talloc\tdriver%%\ttrace\n");
+    else
+        printf("%8s%8s%8s%9s  %s\n", "total", "driver", "alloc", "driver%",
+               "trace");
+    for (i = 0; i < n; i++) {
+        const stats_t *st = &stats[i];
+        double total, driver;
+        if (!st->valid || !st->base_valid)
+            continue;
+        total = st->secs / st->ops * 1e9;
+        driver = st->base_secs / st->ops * 1e9;
+        printf(tab_mode ? "%.1f\t%.1f\t%.1f\t%.1f\t%s\n"
+                        : "%8.1f%8.1f%8.1f%8.1f%%  %s\n",
+               total, driver, total - driver, 100.0 * driver / total,
+               st->filename);
+        ops += st->ops;
+        alloc_secs += st->secs - st->base_secs;
+    }
+    if (alloc_secs > 0)
+        printf("Allocator-only throughput = %.0f Kops/sec\n",
+               ops / (alloc_secs * 1000.0));
+    printf("\n");
+}
+
+/*
+ * cycles_self - Ticks a routine took itself in the util run, less the
+ *     estimated cost of timing its calls
+ */
+static double cycles_self(const mm_cycles_t *c, int fn)
+{
+    double self = (double) c->self[fn] - (double) c->calls[fn] * c->overhead;
+    return self > 0 ? self : 0;
+}
+
+/*
+ * printcycles - prints, for each trace, the share of the allocator's
+ *     time each of its routines took itself in the util run, then each
+ *     routine's calls and ticks per call over all traces
+ */
+static void printcycles(int n, stats_t *stats)
+{
+    double calls[MM_NUM_FNS] = {0}, self[MM_NUM_FNS] = {0};
+    double all[MM_NUM_FNS] = {0}, total;
+    uint64_t overhead = 0;
+    int i, j, count = 0;
+
+    printf("Time by routine, %% of self ticks in the util run:\n");
+    printf(tab_mode ? "ticks/op" : "%9s", "ticks/op");
+    for (j = 0; j < MM_NUM_FNS; j++)
+        printf(tab_mode ? "\t%s" : "%8s", mm_fn_labels[j]);
+    printf(tab_mode ? "\ttrace\n" : "  trace\n");
+    for (i = 0; i < n; i++) {
+        const stats_t *st = &stats[i];
+        if (!st->valid || !st->cycles_valid)
+            continue;
+        total = 0;
+        for (j = 0; j < MM_NUM_FNS; j++) {
+            total += cycles_self(&st->cycles, j);
+            calls[j] += st->cycles.calls[j];
+            self[j] += cycles_self(&st->cycles, j);
+            all[j] += st->cycles.cycles[j];
+        }
+        overhead = st->cycles.overhead;
+        printf(tab_mode ? "%.1f" : "%9.1f", st->ops > 0 ? total / st->ops : 0.0);
+        for (j = 0; j < MM_NUM_FNS; j++)
+            printf(tab_mode ? "\t%.1f" : "%7.1f%%", total > 0 ?
+                   100.0 * cycles_self(&st->cycles, j) / total : 0.0);
+        printf(tab_mode ? "\t%s\n" : "  %s\n", st->filename);
+        count++;
+    }
+    if (count == 0) {
+        printf("No cycle counts: build mm.c with make MMCYCLES=1\n\n");
+        return;
+    }
+
+    printf("\nAll traces (timing costs about %llu ticks per call, "
+           "taken out of self):\n", (unsigned long long) overhead);
+    printf(tab_mode ? "routine\tcalls\tself/call\tall/call\n"
+                    : "%-18s%12s%11s%11s\n", "routine", "calls",
+           "self/call", "all/call");
+    for (j = 0; j < MM_NUM_FNS; j++) {
+        if (calls[j] == 0)
+            continue;
+        printf(tab_mode ? "%s\t%.0f\t%.1f\t%.1f\n" : "%-18s%12.0f%11.1f%11.1f\n",
+               mm_fn_names[j], calls[j], self[j] / calls[j], all[j] / calls[j]);
+    }
+    printf("\n");
+}
+
+/*
+ * printbound - prints each trace's heap next to the aligned lower bound
+ *              on it, and how far above the bound the allocator is
+ */
+static void printbound(int n, stats_t *stats)
+{
+    int i, count = 0;
+    double sum = 0;
+
+    printf("Heap against the aligned lower bound (bytes):\n");
+    if (tab_mode)
+        printf("heap\tpayload\tbound\tutil\tbutil\tgap%%\ttrace\n");
+    else
+        printf("%11s%11s%11s%7s%7s%8s  %s\n", "heap", "payload", "bound",
+               "util", "butil", "gap", "trace");
+    for (i = 0; i < n; i++) {
+        const stats_t *st = &stats[i];
+        if (!st->valid || st->heap_bytes <= 0)
+            continue;
+        printf(tab_mode ? "%.0f\t%.0f\t%.0f\t%.1f\t%.1f\t%.1f\t%s\n"
+                        : "%11.0f%11.0f%11.0f%6.1f%%%6.1f%%%7.1f%%  %s\n",
+               st->heap_bytes, st->peak_bytes, st->bound_bytes,
+               100.0 * st->peak_bytes / st->heap_bytes,
+               100.0 * st->bound_bytes / st->heap_bytes,
+               st->bound_bytes > 0 ?
+               100.0 * (st->heap_bytes / st->bound_bytes - 1) : 0.0,
+               st->filename);
+        sum += st->bound_bytes / st->heap_bytes;
+        count++;
+    }
+    if (count > 0)
+        printf("Average utilization against the bound = %.1f%%\n",
+               100.0 * sum / count);
+    printf("\n");
+}
+
+/*
+ * printcold - prints warm and cold-cache throughput side by side
+ */
+static void printcold(int n, stats_t *stats)
+{
+    int i;
+
+    printf("Warm vs cold-cache throughput (Kops/s, %s):\n",
+           cold_mode == COLD_CLFLUSH ? "heap flushed" : "cache swept");
+    if (tab_mode)
+        printf("warm\tcold\tcold/warm\ttrace\n");
+    else
+        printf("%9s%9s%11s  %s\n", "warm", "cold", "cold/warm", "trace");
+    for (i = 0; i < n; i++) {
+        const stats_t *st = &stats[i];
+        if (!st->valid || !st->cold_valid)
+            continue;
+        printf(tab_mode ? "%.0f\t%.0f\t%.2f\t%s\n" : "%9.0f%9.0f%11.2f  %s\n",
+               st->tput, st->tput_cold, st->tput_cold / st->tput, st->filename);
+    }
+    printf("\n");
+}
+
+/*
+ * printtiming - in robust mode, prints the median throughput of each
+ *               trace with its confidence interval next to the K-best
+ *               figure, and warns about traces whose K-best
+ *               measurement never converged.  Short traces rarely
+ *               converge, so plain runs only warn with -V.
+ */
+static void printtiming(int n, stats_t *stats)
+{
+    int i, unconverged = 0;
+
+    for (i = 0; i < n; i++)
+        if (stats[i].valid && stats[i].nsamples > 0 && !stats[i].converged)
+            unconverged++;
+
+    if (robust_samples > 0) {
+        printf("Throughput (Kops/s), median of samples with 95%% CI:\n");
+        if (tab_mode)
+            printf("kbest\tmedian\tci_lo\tci_hi\t+/-%%\tsamples\tconv\ttrace\n");
+        else
+            printf("%9s%9s%9s%9s%7s%8s%6s  %s\n", "kbest", "median",
+                   "ci_lo", "ci_hi", "+/-%", "samples", "conv", "trace");
+        for (i = 0; i < n; i++) {
+            const stats_t *st = &stats[i];
+            if (!st->valid || !st->robust)
+                continue;
+            printf(tab_mode ? "%.0f\t%.0f\t%.0f\t%.0f\t%.1f\t%d\t%s\t%s\n"
+                            : "%9.0f%9.0f%9.0f%9.0f%7.1f%8d%6s  %s\n",
+                   st->tput_best, st->tput, st->tput_ci[0], st->tput_ci[1],
+                   50.0 * (st->tput_ci[1] - st->tput_ci[0]) / st->tput,
+                   st->nsamples, st->converged ? "yes" : "no", st->filename);
+        }
+        printf("\n");
+    }
+
+    if (unconverged > 0 && (robust_samples > 0 || verbose > 1))
+        printf("Note: K-best timing did not converge for %d trace%s; "
+               "throughput may be noisy%s\n\n", unconverged,
+               unconverged > 1 ? "s" : "",
+               robust_samples > 0 ? "" : " (try --robust <n>)");
+}
+
+/*
+ * printcomparison - prints util and Kops of the built-in mm.c (stats[0])
+ *                   and every allocator loaded with -a side by side,
+ *                   then the errors each one had
+ */
+static void printcomparison(int n, stats_t **stats, const int *errs)
+{
+    int i, a;
+    const mm_ops_t *ops;
+
+    printf("Allocator comparison:\n");
+    for (a = 0; a <= num_extra_allocs; a++) {
+        ops = a == 0 ? &mm_builtin_ops : extra_allocs[a-1];
+        printf(tab_mode ? "%s util\t%s Kops\t" : "%18s ", ops->name, ops->name);
+    }
+    printf(tab_mode ? "trace\n" : " trace\n");
+    if (!tab_mode) {
+        for (a = 0; a <= num_extra_allocs; a++)
+            printf("%10s%8s ", "util", "Kops");
+        printf("\n");
+    }
+    for (i = 0; i < n; i++) {
+        for (a = 0; a <= num_extra_allocs; a++) {
+            stats_t *st = &stats[a][i];
+            if (!st->valid)
+                printf(tab_mode ? "\t\t" : "%10s%8s ", "-", "-");
+            else if (tab_mode)
+                printf("%.1f\t%.0f\t", st->util * 100.0,
+                       sparse_mode ? 0.0 : st->tput);
+            else
+                printf("%9.1f%%%8.0f ", st->util * 100.0,
+                       sparse_mode ? 0.0 : st->tput);
+        }
+        printf("%s%s\n", tab_mode ? "" : " ", stats[0][i].filename);
+    }
+    for (a = 0; a <= num_extra_allocs; a++) {
+        ops = a == 0 ? &mm_builtin_ops : extra_allocs[a-1];
+        if (errs[a] > 0)
+            printf("%s: %d error%s\n", ops->name, errs[a],
+                   errs[a] > 1 ? "s" : "");
+    }
+    printf("\n");
+}
+
+/*
+ * read_cpu_model - copy the "model name" line of /proc/cpuinfo into buf
+ */
+static void read_cpu_model(char *buf, size_t len)
+{
+    char line[MAXLINE];
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+
+    snprintf(buf, len, "unknown");
+    if (fp == NULL)
+        return;
+    while (fgets(line, sizeof(line), fp)) {
+        char *colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && colon != NULL) {
+            snprintf(buf, len, "%s", colon + 2);
+            buf[strcspn(buf, "\n")] = '\0';
+            break;
+        }
+    }
+    fclose(fp);
+}
+
+/*
+ * write_json - Write every stats_t field for every trace, the summary
+ *     and some metadata about the environment to path as JSON.
+ */
+static void write_json(const char *path, int n, stats_t *stats,
+                       double avg_util, double avg_tput, double perfindex,
+                       int argc, char **argv)
+{
+    FILE *fp;
+    struct utsname un;
+    char host[MAXLINE], cpu[MAXLINE], date[64];
+    time_t now = time(NULL);
+    int i, j, k;
+
+    if ((fp = fopen(path, "w")) == NULL)
+        unix_error("Could not create %s", path);
+    if (gethostname(host, sizeof(host)) != 0)
+        strcpy(host, "unknown");
+    host[sizeof(host) - 1] = '\0';
+    if (uname(&un) != 0)
+        memset(&un, 0, sizeof(un));
+    read_cpu_model(cpu, sizeof(cpu));
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+
+    fprintf(fp, "{\n  \"env\": {\n    \"host\": ");
+    json_write_string(fp, host);
+    fprintf(fp, ",\n    \"kernel\": ");
+    json_write_string(fp, un.release);
+    fprintf(fp, ",\n    \"machine\": ");
+    json_write_string(fp, un.machine);
+    fprintf(fp, ",\n    \"cpu\": ");
+    json_write_string(fp, cpu);
+    fprintf(fp, ",\n    \"ncpus\": %ld", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(fp, ",\n    \"compiler\": ");
+    json_write_string(fp, __VERSION__);
+    fprintf(fp, ",\n    \"date\": ");
+    json_write_string(fp, date);
+    fprintf(fp, ",\n    \"args\": [");
+    for (i = 0; i < argc; i++) {
+        fprintf(fp, i ? ", " : "");
+        json_write_string(fp, argv[i]);
+    }
+    fprintf(fp, "],\n    \"debug_mode\": %d,\n    \"sparse_mode\": %s,\n"
+            "    \"samples\": %d,\n    \"robust\": %d,\n    \"warmup\": %d,\n"
+            "    \"pin\": %d,\n    \"mm_conf\": ",
+            debug_mode, sparse_mode ? "true" : "false", timing_samples,
+            robust_samples, warmup_runs, pin_cpu);
+    if (getenv("MM_CONF"))
+        json_write_string(fp, getenv("MM_CONF"));
+    else
+        fprintf(fp, "null");
+    fprintf(fp, "\n  },\n");
+
+    fprintf(fp, "  \"traces\": [");
+    for (i = 0; i < n; i++) {
+        stats_t *st = &stats[i];
+        fprintf(fp, "%s\n    {\"filename\": ", i ? "," : "");
+        json_write_string(fp, st->filename);
+        fprintf(fp, ", \"weight\": %d, \"ops\": %.0f, \"valid\": %s",
+                st->weight, st->ops, st->valid ? "true" : "false");
+        fprintf(fp, ",\n     \"secs\": %.9g, \"tput\": %.6g, \"util\": %.6g",
+                st->secs, st->tput, st->util);
+        if (st->heap_bytes > 0)
+            fprintf(fp, ", \"heap_bytes\": %.0f, \"bound_bytes\": %.0f",
+                    st->heap_bytes, st->bound_bytes);
+        fprintf(fp, ",\n     \"tput_samples\": [");
+        for (k = 0; k < st->nsamples; k++)
+            fprintf(fp, "%s%.6g", k ? ", " : "", st->tput_samples[k]);
+        fprintf(fp, "], \"converged\": %s",
+                st->converged ? "true" : "false");
+        if (st->robust)
+            fprintf(fp, ",\n     \"tput_best\": %.6g, \"tput_ci\": [%.6g, %.6g]",
+                    st->tput_best, st->tput_ci[0], st->tput_ci[1]);
+        if (st->cold_valid)
+            fprintf(fp, ", \"tput_cold\": %.6g", st->tput_cold);
+        if (st->base_valid)
+            fprintf(fp, ", \"driver_secs\": %.9g", st->base_secs);
+        if (st->mm_valid)
+            write_mm_stats(fp, &st->mm);
+        if (st->lat_valid) {
+            fprintf(fp, ",\n     \"%s\": {",
+                    st->lat_ns ? "latency_ns" : "latency_ticks");
+            for (j = 0; j < NUM_LAT_OPS; j++) {
+                fprintf(fp, "%s\"%s\": {", j ? ", " : "", lat_op_names[j]);
+                for (k = 0; k < NUM_LAT_PCTS; k++)
+                    fprintf(fp, "%s\"%s\": %.0f", k ? ", " : "",
+                            lat_pct_names[k], st->lat[j][k]);
+                fprintf(fp, "}");
+            }
+            fprintf(fp, "}");
+        }
+        if (st->perf_valid) {
+            fprintf(fp, ",\n     \"events_per_op\": {");
+            for (j = 0; j < PC_NUM; j++) {
+                fprintf(fp, "%s\"%s\": ", j ? ", " : "", perfctr_names[j]);
+                if (st->perf[j] < 0)
+                    fprintf(fp, "null");
+                else
+                    fprintf(fp, "%.6g", st->perf[j]);
+            }
+            fprintf(fp, "}");
+        }
+        if (st->cycles_valid) {
+            fprintf(fp, ",\n     \"mm_cycles\": {");
+            for (j = 0; j < MM_NUM_FNS; j++)
+                fprintf(fp, "%s\"%s\": {\"calls\": %llu, \"cycles\": %llu, "
+                        "\"self\": %llu}", j ? ",\n       " : "", mm_fn_names[j],
+                        (unsigned long long) st->cycles.calls[j],
+                        (unsigned long long) st->cycles.cycles[j],
+                        (unsigned long long) st->cycles.self[j]);
+            fprintf(fp, "}");
+        }
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ],\n");
+
+    fprintf(fp, "  \"summary\": {\"util\": %.6g, \"tput\": %.6g, "
+            "\"perfindex\": %.1f, \"errors\": %d}\n}\n",
+            avg_util, avg_tput, perfindex, errors);
+    fclose(fp);
+}
+
+/*
+ * write_mm_stats - the allocator's own counters, as a JSON member
+ */
+static void write_mm_stats(FILE *fp, const mm_stats_t *ms)
+{
+    int j;
+
+    fprintf(fp, ",\n     \"mm_stats\": {\"heap_bytes\": %zu, \"alloc_bytes\": %zu, "
+            "\"alloc_blocks\": %zu,\n       \"mallocs\": %zu, \"frees\": %zu, "
+            "\"reallocs\": %zu, \"realloc_inplace\": %zu, \"realloc_copy\": %zu,"
+            "\n       \"extend_calls\": %zu, \"fit_calls\": %zu, "
+            "\"fit_probes\": %zu, \"fit_misses\": %zu,\n       \"bins\": [",
+            ms->heap_bytes, ms->alloc_bytes, ms->alloc_blocks, ms->mallocs,
+            ms->frees, ms->reallocs, ms->realloc_inplace, ms->realloc_copy,
+            ms->extend_calls, ms->fit_calls, ms->fit_probes, ms->fit_misses);
+    for (j = 0; j < ms->nbins && j < MM_MAX_BINS; j++)
+        fprintf(fp, "%s{\"limit\": %zu, \"free_bytes\": %zu, \"free_blocks\": %zu}",
+                j ? ", " : "", ms->bin_limit[j], ms->free_bytes[j],
+                ms->free_blocks[j]);
+    fprintf(fp, "]}");
+}
+
+/*
+ * mean_var - mean and sample variance of n values
+ */
+static void mean_var(const double *x, int n, double *mean, double *var)
+{
+    int i;
+    double sum = 0, sq = 0;
+    for (i = 0; i < n; i++)
+        sum += x[i];
+    *mean = n > 0 ? sum / n : 0;
+    for (i = 0; i < n; i++)
+        sq += (x[i] - *mean) * (x[i] - *mean);
+    *var = n > 1 ? sq / (n - 1) : 0;
+}
+
+/*
+ * tput_significant - Welch's t-test on two sets of throughput samples.
+ *     Returns 1 if the means differ at the 95% level, 0 if not, and -1
+ *     if either side has too few samples to tell.
+ */
+static int tput_significant(const double *a, int na, const double *b, int nb)
+{
+    /* Two-sided 95% critical values of Student's t for 1..30 dof */
+    static const double tcrit[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    double ma, va, mb, vb, se2, t, dof;
+
+    if (na < 2 || nb < 2)
+        return -1;
+    mean_var(a, na, &ma, &va);
+    mean_var(b, nb, &mb, &vb);
+    se2 = va / na + vb / nb;
+    if (se2 == 0)
+        return ma != mb;
+    t = fabs(ma - mb) / sqrt(se2);
+    dof = se2 * se2 / ((va / na) * (va / na) / (na - 1) +
+                       (vb / nb) * (vb / nb) / (nb - 1));
+    if (dof < 1)
+        dof = 1;
+    return t > (dof > 30 ? 1.96 : tcrit[(int) dof - 1]);
+}
+
+/*
+ * compare_results - Compare this run against a baseline written by
+ *     --json.  A trace regresses if it became invalid, if its weighted
+ *     utilization dropped by more than regress_threshold percent, or if
+ *     its weighted throughput dropped by more than that and the drop is
+ *     significant.  A drop that cannot be tested, because either side
+ *     has fewer than 2 samples, is reported as untested but does not
+ *     count.  Prints a table and returns the number of regressions.
+ */
+static int compare_results(const char *path, int n, stats_t *stats)
+{
+    char err[MAXLINE];
+    json_value_t *base = json_parse_file(path, err, sizeof(err));
+    json_value_t *traces;
+    int i, j, regressions = 0, untested = 0;
+
+    if (base == NULL)
+        app_error("Could not load baseline: %s\n", err);
+    traces = json_get(base, "traces");
+
+    printf("Comparison with baseline %s (threshold %.1f%%):\n",
+           path, regress_threshold);
+    printf("  %8s%8s%10s%8s%7s  %-9s %s\n", "util", "dutil", "Kops",
+           "dKops", "signif", "verdict", "trace");
+    for (i = 0; i < n; i++) {
+        stats_t *st = &stats[i];
+        json_value_t *bt = NULL;
+        double bsamples[MAX_TPUT_SAMPLES];
+        int nb = 0, sig = -1;
+        bool regressed = false, improved = false, unsure = false;
+        const char *verdict;
+
+        for (j = 0; (bt = json_at(traces, j)) != NULL; j++) {
+            const char *name = json_string(json_get(bt, "filename"));
+            if (name && strcmp(name, st->filename) == 0)
+                break;
+        }
+        if (bt == NULL) {
+            printf("  %8s%8s%10s%8s%7s  %-9s %s\n",
+                   "", "", "", "", "", "new", st->filename);
+            continue;
+        }
+
+        bool bvalid = json_number(json_get(bt, "valid"), 0) != 0;
+        double butil = json_number(json_get(bt, "util"), 0);
+        double btput = json_number(json_get(bt, "tput"), 0);
+        json_value_t *bs = json_get(bt, "tput_samples");
+        for (nb = 0; nb < MAX_TPUT_SAMPLES && json_at(bs, nb); nb++)
+            bsamples[nb] = json_number(json_at(bs, nb), 0);
+
+        if (!st->valid || !bvalid) {
+            regressed = bvalid && !st->valid;
+            printf("  %8s%8s%10s%8s%7s  %-9s %s\n", "-", "-", "-", "-", "",
+                   regressed ? "REGRESSED" : "invalid", st->filename);
+            regressions += regressed;
+            continue;
+        }
+
+        double dutil = butil > 0 ? (st->util - butil) / butil * 100.0 : 0;
+        double dtput = btput > 0 ? (st->tput - btput) / btput * 100.0 : 0;
+        sig = tput_significant(st->tput_samples, st->nsamples, bsamples, nb);
+
+        if (st->weight == WALL || st->weight == WUTIL) {
+            regressed = regressed || dutil < -regress_threshold;
+            improved = improved || dutil > regress_threshold;
+        }
+        if (!sparse_mode && (st->weight == WALL || st->weight == WPERF)) {
+            regressed = regressed || (dtput < -regress_threshold && sig == 1);
+            improved = improved || (dtput > regress_threshold && sig == 1);
+            unsure = dtput < -regress_threshold && sig < 0;
+        }
+        if (regressed)
+            verdict = "REGRESSED";
+        else if (unsure)
+            verdict = "untested";
+        else if (improved)
+            verdict = "improved";
+        else if (sig == 1)
+            verdict = "minor";
+        else
+            verdict = "same";
+        regressions += regressed;
+        untested += !regressed && unsure;
+
+        printf("  %7.1f%%%+7.1f%%%10.0f%+7.1f%%%7s  %-9s %s\n",
+               st->util * 100.0, dutil, st->tput, dtput,
+               sig < 0 ? "?" : (sig ? "yes" : "no"), verdict, st->filename);
+    }
+    printf("%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+    if (untested > 0)
+        printf("%d throughput drop%s could not be tested for noise; "
+               "use --samples 2 or more on both runs\n", untested,
+               untested == 1 ? "" : "s");
+    printf("\n");
+    json_free(base);
+    return regressions;
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1697,6 +3717,42 @@ static void usage(char *prog)
     fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
+    fprintf(stderr, "\t-j <n>     Evaluate up to <n> traces in parallel processes; timed\n"
+                    "\t           runs take turns, but other workers' checks still share\n"
+                    "\t           the caches, so Kops are not comparable to serial runs\n");
+    fprintf(stderr, "\t-a <lib>   Also run the allocator in shared object <lib> and\n"
+                    "\t           compare (repeatable)\n");
+    fprintf(stderr, "\t-F <k>     Write a fragmentation timeline, sampled every <k> ops,\n"
+                    "\t           to <trace>.frag.csv and <trace>.frag.json\n");
+    fprintf(stderr, "\t--json <file>       Write all results as JSON to <file>\n");
+    fprintf(stderr, "\t--samples <n>       Take <n> independent timing samples per trace\n");
+    fprintf(stderr, "\t--robust <n>        Take at least <n> timing samples and score by\n"
+                    "\t                    their median, with a 95%% CI\n");
+    fprintf(stderr, "\t--warmup <n>        Run each trace <n> times untimed before timing\n");
+    fprintf(stderr, "\t--pin <cpu>         Run on CPU <cpu> only\n");
+    fprintf(stderr, "\t--tsc               Time with the calibrated time stamp counter\n");
+    fprintf(stderr, "\t--baseline          Also time a null allocator and report ns/op\n"
+                    "\t                    with the driver's overhead removed\n");
+    fprintf(stderr, "\t--bound             Report each heap against the aligned lower\n"
+                    "\t                    bound on it (see also tracebound)\n");
+    fprintf(stderr, "\t--heap-profile      Write mm.c's sampled heap profile at each trace's\n"
+                    "\t                    peak to <trace>.heap (set MM_CONF=prof_sample:<n>)\n");
+    fprintf(stderr, "\t--events            Write mm.c's last events on each trace to\n"
+                    "\t                    <trace>.events (build with make MMTRACE=1)\n");
+    fprintf(stderr, "\t--cycles            Break mm.c's time down by internal routine\n"
+                    "\t                    (build with make MMCYCLES=1)\n");
+    fprintf(stderr, "\t--heap-map          Write a snapshot of mm.c's heap at each trace's\n"
+                    "\t                    peak to <trace>.heapmap, for mmheap\n");
+    fprintf(stderr, "\t--cold <how>        Also time with a cold cache before every run:\n"
+                    "\t                    sweep (a buffer twice the LLC) or clflush (the heap)\n");
+    fprintf(stderr, "\t--sweep <k>         With -D, recheck every block every <k> ops\n"
+                    "\t                    (default %d; 1 checks before each op)\n",
+            DEFAULT_SWEEP);
+    fprintf(stderr, "\t--compare <file>    Compare against a --json baseline; exit %d on\n"
+                    "\t                    regression\n", EXIT_REGRESSION);
+    fprintf(stderr, "\t--threshold <pct>   Drop counted as a regression (default 5)\n");
     fprintf(stderr, "\t-T         Print diagnostics in tab mode\n");
+    fprintf(stderr, "\t-L         Report per-op latency percentiles\n");
+    fprintf(stderr, "\t-P         Report hardware performance counters per op\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file\n");
 }
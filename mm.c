@@ -48,6 +48,13 @@
 
 /* You can change anything from here onward */
 
+#include <execinfo.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
 /*
  * If DEBUG is defined, enable printing on dbg_printf and contracts.
  * Debugging macros, with names beginning "dbg_" are allowed.
@@ -74,7 +81,10 @@ typedef uint64_t word_t;
 static const size_t wsize = sizeof(word_t);   // word and header size (bytes)
 static const size_t dsize = 2*sizeof(word_t);       // double word size (bytes)
 static const size_t min_block_size = 2*sizeof(word_t); // Minimum block size
-static const size_t chunksize = (1 << 12);    // requires (chunksize % 16 == 0)
+#ifndef CHUNKSIZE
+#define CHUNKSIZE (1 << 12)                    // overridable at build time
+#endif
+static size_t chunksize = CHUNKSIZE;    // requires (chunksize % 16 == 0); mm_ctl
 
 /* Masks */
 static const word_t alloc_mask = 0x1;
@@ -143,13 +153,20 @@ static block_t *find_prev(block_t *block);
 static block_t *freeList_start = NULL;
 
 /* Segregated list sizes */
-#define SLIST_SIZE 7
+/* Size of the small blocks, which keep their links in header and footer */
 #define SIZE_1 16
-#define SIZE_2 32
-#define SIZE_3 64
-#define SIZE_4 128
-#define SIZE_5 256
-#define SIZE_6 512
+
+/* Segregated list limits: list 0 holds the small blocks, each following
+ * list the blocks up to its limit, and the last list everything larger.
+ * SLIST_LIMITS may be set at build time; mmtune searches over it, N_SIZE
+ * and CHUNKSIZE, and writes the best as a header to build with.
+ */
+#ifndef SLIST_LIMITS
+#define SLIST_LIMITS 32, 64, 128, 256, 512
+#endif
+static const size_t sList_limits[] = { SIZE_1, SLIST_LIMITS };
+#define SLIST_SIZE ((int) (sizeof(sList_limits) / sizeof(sList_limits[0])) + 1)
+_Static_assert(SLIST_SIZE <= MM_MAX_BINS, "too many segregated lists");
 
 /* Segregated list functions */
 static block_t *sList[SLIST_SIZE];
@@ -182,7 +199,113 @@ static void print_heap();
 
 /* N-Fit defintions */
 #define MAX_INT 0x7fffffff
+#ifndef N_SIZE
 #define N_SIZE 70
+#endif
+static size_t fit_depth = N_SIZE;       // blocks find_fit weighs; mm_ctl
+static size_t prof_sample = 0;          // mean bytes between samples, 0 = off
+static size_t stats_enabled = 1;        // count calls and searches; mm_ctl
+static size_t last_fit_probes = 0;      // blocks the last find_fit examined
+
+/* Run-time tunables, set with mm_ctl or the MM_CONF environment variable */
+typedef struct {
+    const char *name;
+    size_t *value;
+    size_t min;        // smallest value allowed
+    size_t max;        // largest value allowed, 0 = no limit
+    size_t multiple;   // values must be a multiple of this
+} tunable_t;
+
+static const tunable_t tunables[] = {
+    { "fit_depth",  &fit_depth, 1,  0, 1 },
+    { "chunk_size", &chunksize, 16, 0, 16 },
+    { "prof_sample", &prof_sample, 0, 0, 1 },
+    { "stats", &stats_enabled, 0, 1, 1 },
+};
+#define NUM_TUNABLES (sizeof(tunables) / sizeof(tunables[0]))
+
+static void read_conf(void);
+
+/* Counters for mm_stats */
+static mm_stats_t counters;
+
+/*
+ * Heap profiler.  Its tables are mmapped on first use so that samples
+ * never come from (or perturb) the heap being profiled.
+ */
+#define PROF_DEPTH 32                 // frames kept per stack
+#define PROF_LIVE_BITS 16
+#define PROF_LIVE_SLOTS (1 << PROF_LIVE_BITS) // sampled blocks live at once, x2
+#define PROF_STACK_SLOTS (1 << 12)    // distinct allocation stacks, x2
+
+typedef struct {
+    void *ptr;         // payload of a live sampled block, NULL if empty
+    size_t size;       // bytes requested
+    int stack;         // its slot in prof_stacks
+} prof_live_t;
+
+typedef struct {
+    int depth;                      // frames, 0 if the slot is empty
+    size_t live_count, live_bytes;  // samples not yet freed
+    size_t total_count, total_bytes;// every sample since mm_init
+    void *frames[PROF_DEPTH];
+} prof_stack_t;
+
+static long prof_countdown = -1;       // bytes left until the next sample
+static bool prof_armed = false;        // has prof_countdown been drawn?
+static bool prof_busy = false;         // inside backtrace, which may malloc
+static uint64_t prof_rng = 0x9e3779b97f4a7c15;
+static prof_live_t *prof_live = NULL;
+static prof_stack_t *prof_stacks = NULL;
+static size_t prof_live_count = 0;
+static size_t prof_stack_count = 0;
+
+static void prof_reset(void);
+static void prof_malloc(void *bp, size_t size);
+static void prof_free(void *bp);
+
+/*
+ * Event trace, compiled in with -DMM_TRACE: a ring of the last
+ * MM_TRACE_EVENTS events, mmapped on first use.  mm.c serves a single
+ * thread, so one ring with a plain write index is enough.  Without
+ * MM_TRACE, trace_clock and trace_event are empty and compile away.
+ */
+#ifndef MM_TRACE_EVENTS
+#define MM_TRACE_EVENTS (1 << 16)     // a power of two
+#endif
+_Static_assert((MM_TRACE_EVENTS & (MM_TRACE_EVENTS - 1)) == 0,
+               "MM_TRACE_EVENTS must be a power of two");
+
+static int trace_nesting = 0;          // inside realloc's own calls
+
+#ifdef MM_TRACE
+static mm_event_t *trace_ring = NULL;
+static uint64_t trace_count = 0;       // events since mm_init
+static uint64_t trace_tick0;           // clock when the ring was mapped
+static struct timespec trace_time0;
+#endif
+
+static uint64_t trace_clock(void);
+static void trace_event(int op, uint64_t start, const void *addr,
+                        const void *old, size_t size, int bin, size_t search);
+
+/*
+ * Cycle accounting, compiled in with -DMM_CYCLES: each internal routine
+ * adds up its calls and timestamp ticks, with and without the routines
+ * it calls.  Without MM_CYCLES, cyc_enter and cyc_exit are empty.
+ */
+#define CYC_MAX_DEPTH 8                // nested timed calls tracked
+
+#ifdef MM_CYCLES
+static mm_cycles_t cycle_counts;
+static uint64_t cyc_child[CYC_MAX_DEPTH]; // ticks in callees, per open call
+static int cyc_depth = 0;
+
+static void cyc_reset(void);
+#endif
+
+static uint64_t cyc_enter(void);
+static void cyc_exit(mm_fn_t fn, uint64_t start);
 
 /* Block shift defintions */
 #define PREV_ALLOC_SHIFT 1
@@ -201,6 +324,9 @@ static void print_heap();
  */
 bool mm_init(void)
 {
+    // Settings from the environment, on the first call only
+    read_conf();
+
     // Create the initial empty heap
     word_t *start = (word_t *)(mem_sbrk(2*wsize));
 
@@ -208,6 +334,15 @@ bool mm_init(void)
     {
         return false;
     }
+    memset(&counters, 0, sizeof(counters));
+    counters.heap_bytes = 2*wsize;
+    prof_reset();
+#ifdef MM_TRACE
+    trace_count = 0;
+#endif
+#ifdef MM_CYCLES
+    cyc_reset();
+#endif
 
     start[0] = pack(0, true, true); // Prologue footer
     start[1] = pack(0, true, true); // Epilogue header
@@ -243,14 +378,22 @@ void *malloc(size_t size)
     size_t extendsize; // Amount to extend heap if no fit is found
     block_t *block;
     void *bp = NULL;
+    uint64_t start, cycles;
 
     if (heap_start == NULL) // Initialize heap if it isn't initialized
     {
         mm_init();
     }
+    if (stats_enabled)
+    {
+        counters.mallocs++;
+    }
+    start = trace_clock();
+    cycles = cyc_enter();
 
     if (size == 0) // Ignore spurious request
     {
+        cyc_exit(MM_FN_MALLOC, cycles);
         dbg_ensures(mm_checkheap(__LINE__));
         return bp;
     }
@@ -268,17 +411,33 @@ void *malloc(size_t size)
     // If no fit is found, request more memory, and then and place the block
     if (block == NULL)
     {
+        if (stats_enabled)
+        {
+            counters.fit_misses++;
+        }
         extendsize = max(asize, chunksize);
         block = extend_heap(extendsize);
         if (block == NULL) // extend_heap returns an error
         {
+            cyc_exit(MM_FN_MALLOC, cycles);
             return bp;
         }
 
     }
 
     place(block, asize);
+    counters.alloc_bytes += get_size(block);
+    counters.alloc_blocks++;
     bp = header_to_payload(block);
+
+    // Sampled allocations are charged to the caller's stack
+    if (prof_sample != 0 && (prof_countdown -= (long) size) < 0)
+    {
+        prof_malloc(bp, size);
+    }
+    trace_event(MM_EV_MALLOC, start, bp, NULL, size, size_to_sList(asize),
+                last_fit_probes);
+    cyc_exit(MM_FN_MALLOC, cycles);
     dbg_ensures(mm_checkheap(__LINE__));
     return bp;
 }
@@ -289,17 +448,34 @@ void *malloc(size_t size)
  */
 void free(void *bp)
 {
+    uint64_t start = trace_clock();
+    uint64_t cycles = cyc_enter();
+
+    if (stats_enabled)
+    {
+        counters.frees++;
+    }
     if (bp == NULL)
     {
+        cyc_exit(MM_FN_FREE, cycles);
         return;
     }
 
+    if (prof_live_count != 0)
+    {
+        prof_free(bp);
+    }
+
     block_t *block = payload_to_header(bp);
     size_t size = get_size(block);
+    counters.alloc_bytes -= size;
+    counters.alloc_blocks--;
     write_header(block, size, false, get_prev_alloc(block));
     write_footer(block, size, false);
 
-    coalesce(block);
+    block = coalesce(block);
+    trace_event(MM_EV_FREE, start, bp, NULL, size, block_to_sList(block), 0);
+    cyc_exit(MM_FN_FREE, cycles);
 }
 
 /*
@@ -311,26 +487,45 @@ void *realloc(void *ptr, size_t size)
     block_t *block = payload_to_header(ptr);
     size_t copysize;
     void *newptr;
+    uint64_t start = trace_clock();
+    uint64_t cycles = cyc_enter();
+
+    if (stats_enabled)
+    {
+        counters.reallocs++;
+    }
 
     // If size == 0, then free block and return NULL
     if (size == 0)
     {
+        trace_nesting++;
         free(ptr);
+        trace_nesting--;
+        trace_event(MM_EV_REALLOC, start, NULL, ptr, 0, -1, 0);
+        cyc_exit(MM_FN_REALLOC, cycles);
         return NULL;
     }
 
     // If ptr is NULL, then equivalent to malloc
     if (ptr == NULL)
     {
-        return malloc(size);
+        trace_nesting++;
+        newptr = malloc(size);
+        trace_nesting--;
+        trace_event(MM_EV_REALLOC, start, newptr, NULL, size, -1, 0);
+        cyc_exit(MM_FN_REALLOC, cycles);
+        return newptr;
     }
 
     // Otherwise, proceed with reallocation
+    trace_nesting++;
     newptr = malloc(size);
 
     // If malloc fails, the original block is left untouched
     if (newptr == NULL)
     {
+        trace_nesting--;
+        cyc_exit(MM_FN_REALLOC, cycles);
         return NULL;
     }
 
@@ -341,9 +536,17 @@ void *realloc(void *ptr, size_t size)
         copysize = size;
     }
     memcpy(newptr, ptr, copysize);
+    // Every realloc moves, so realloc_inplace stays 0
+    if (stats_enabled)
+    {
+        counters.realloc_copy++;
+    }
 
     // Free the old block
     free(ptr);
+    trace_nesting--;
+    trace_event(MM_EV_REALLOC, start, newptr, ptr, size, -1, 0);
+    cyc_exit(MM_FN_REALLOC, cycles);
 
     return newptr;
 }
@@ -383,13 +586,21 @@ void *calloc(size_t elements, size_t size)
 static block_t *extend_heap(size_t size)
 {
     void *bp;
+    uint64_t start = trace_clock();
+    uint64_t cycles = cyc_enter();
     
     // Allocate an even number of words to maintain alignment
     size = round_up(size, dsize);
     if ((bp = mem_sbrk(size)) == (void *)-1)
     {
+        cyc_exit(MM_FN_EXTEND_HEAP, cycles);
         return NULL;
     }
+    if (stats_enabled)
+    {
+        counters.extend_calls++;
+    }
+    counters.heap_bytes += size;
 
     // Initialize free block header/footer
     block_t *block = payload_to_header(bp);
@@ -400,18 +611,24 @@ static block_t *extend_heap(size_t size)
     block_t *block_next = find_next(block);
     write_header(block_next, 0, true, false);
 
-    return coalesce(block);
+    block = coalesce(block);
+    trace_event(MM_EV_EXTEND, start, block, NULL, size, -1, 0);
+    cyc_exit(MM_FN_EXTEND_HEAP, cycles);
+    return block;
 }
 
 /*
  * Adds a free block to the free block list
  */
 static void add_free_block(block_t *block) {
+    uint64_t cycles = cyc_enter();
 
     set_next(block, NULL);
     set_prev(block, NULL);
 
     int index = block_to_sList(block);
+    counters.free_bytes[index] += get_size(block);
+    counters.free_blocks[index]++;
 
     // No block in the sList
     if(!sList[index]) {
@@ -421,18 +638,23 @@ static void add_free_block(block_t *block) {
 	set_prev(sList[index], block);
 	sList[index] = block;
     }
+    cyc_exit(MM_FN_ADD_FREE, cycles);
 }
 
 /*
  * Removes a free block from the free block list
  */
 static void remove_free_block(block_t *block) {
+    uint64_t cycles = cyc_enter();
     int index = block_to_sList(block);
     
     // Nothing in free list
     if(!sList[index]) {
+        cyc_exit(MM_FN_REMOVE_FREE, cycles);
         return;
     }
+    counters.free_bytes[index] -= get_size(block);
+    counters.free_blocks[index]--;
     
     // Block is the start of the free list
     if(!get_prev_free(block)) {
@@ -465,7 +687,7 @@ static void remove_free_block(block_t *block) {
     // Set the block pointers to NULL
     set_prev(block, NULL);
     set_next(block, NULL);
-
+    cyc_exit(MM_FN_REMOVE_FREE, cycles);
 }
 
 /*
@@ -473,6 +695,8 @@ static void remove_free_block(block_t *block) {
  */
 static block_t *coalesce(block_t * block)
 {
+    uint64_t start = trace_clock();
+    uint64_t cycles = cyc_enter();
 
     // Get next block
     block_t *next_block = find_next(block);
@@ -490,6 +714,7 @@ static block_t *coalesce(block_t * block)
         write_header(block, block_size, false, true);
         write_header(next_block, next_block_size, true, false);
         add_free_block(block);
+        cyc_exit(MM_FN_COALESCE, cycles);
         return block;
 
     // Case 2: Has allocated previous block.
@@ -561,6 +786,9 @@ static block_t *coalesce(block_t * block)
     // Add the new block to the free list and return the block
     add_free_block(block);
     //print_block(next_block);
+    trace_event(MM_EV_COALESCE, start, block, NULL, get_size(block),
+                block_to_sList(block), 0);
+    cyc_exit(MM_FN_COALESCE, cycles);
     return block;
 }
 
@@ -570,6 +798,7 @@ static block_t *coalesce(block_t * block)
  */
 static void place(block_t *block, size_t asize)
 {
+    uint64_t cycles = cyc_enter();
     size_t csize = get_size(block);
 block_t *next_block = get_next_free(block);
     
@@ -617,6 +846,7 @@ block_t *next_block = get_next_free(block);
 		     true);
         remove_free_block(block);
     }
+    cyc_exit(MM_FN_PLACE, cycles);
 }
 
 /*
@@ -629,8 +859,14 @@ static block_t *find_fit(size_t asize)
     block_t *best_block = NULL;
     size_t smallest_size = MAX_INT;
     size_t block_size = 0;
-    int n = N_SIZE;
+    size_t n = fit_depth;
+    size_t probes = 0;
     int index = size_to_sList(asize);
+    uint64_t cycles = cyc_enter();
+
+    if (stats_enabled) {
+        counters.fit_calls++;
+    }
 
     /* Loop through all of the segregated lists with valid sizes */ 
     for(;index < SLIST_SIZE; index++) {
@@ -638,6 +874,7 @@ static block_t *find_fit(size_t asize)
 	     block = block->next) {
 
             block_size = get_size(block);
+            probes++;
 
             // Found a free block with a valid size
             if (asize <= block_size) {
@@ -645,6 +882,11 @@ static block_t *find_fit(size_t asize)
 
                 // Return the block if found a perfect size
                 if(block_size == asize) {
+                    last_fit_probes = probes;
+                    if (stats_enabled) {
+                        counters.fit_probes += probes;
+                    }
+                    cyc_exit(MM_FN_FIND_FIT, cycles);
                     return block;
                 }
 
@@ -658,6 +900,11 @@ static block_t *find_fit(size_t asize)
         }
     }
     
+   last_fit_probes = probes;
+   if (stats_enabled) {
+       counters.fit_probes += probes;
+   }
+   cyc_exit(MM_FN_FIND_FIT, cycles);
    return best_block;
 }
 
@@ -736,6 +983,630 @@ bool mm_checkheap(int line)
     return true;
 }
 
+/*
+ * mm_freeinfo: Walks every segregated list and summarizes the free space
+ *              held in each one, along with the largest free block.
+ */
+void mm_freeinfo(mm_freeinfo_t *info)
+{
+    block_t *block;
+    int i;
+
+    memset(info, 0, sizeof(*info));
+    info->nbins = SLIST_SIZE;
+    for (i = 0; i < SLIST_SIZE; i++) {
+        info->bin_limit[i] = i < SLIST_SIZE - 1 ? sList_limits[i] : 0;
+        for (block = sList[i]; block != NULL; block = get_next_free(block)) {
+            size_t size = get_size(block);
+            info->free_bytes[i] += size;
+            info->free_blocks[i]++;
+            if (size > info->largest_free) {
+                info->largest_free = size;
+            }
+        }
+    }
+}
+
+/*
+ * mm_ctl: Reads the named tunable into *oldp and sets it from *newp;
+ *         either may be NULL.  Returns 0, or -1 if there is no such
+ *         tunable or the new value is out of range.
+ */
+int mm_ctl(const char *name, size_t *oldp, const size_t *newp)
+{
+    size_t i;
+
+    for (i = 0; i < NUM_TUNABLES; i++) {
+        const tunable_t *t = &tunables[i];
+        if (strcmp(name, t->name) != 0) {
+            continue;
+        }
+        if (newp != NULL && (*newp < t->min || (t->max && *newp > t->max) ||
+                             *newp % t->multiple != 0)) {
+            return -1;
+        }
+        if (oldp != NULL) {
+            *oldp = *t->value;
+        }
+        if (newp != NULL) {
+            *t->value = *newp;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * read_conf: Applies the settings in the MM_CONF environment variable,
+ *            e.g. "fit_depth:8,chunk_size:16384", the first time it is
+ *            called.  Bad settings are reported and skipped.
+ */
+static void read_conf(void)
+{
+    static bool done = false;
+    const char *conf = getenv("MM_CONF");
+    char name[32];
+
+    if (done || conf == NULL) {
+        done = true;
+        return;
+    }
+    done = true;
+
+    while (*conf != '\0') {
+        size_t len = strcspn(conf, ":,");
+        size_t entry = strcspn(conf, ",");
+        size_t value = 0;
+        char *end = NULL;
+
+        if (conf[len] == ':' && len < sizeof(name)) {
+            memcpy(name, conf, len);
+            name[len] = '\0';
+            value = strtoul(conf + len + 1, &end, 0);
+        }
+        if (end == NULL || end == conf + len + 1 ||
+            (*end != ',' && *end != '\0') || mm_ctl(name, NULL, &value) < 0) {
+            fprintf(stderr, "mm: ignoring bad MM_CONF setting \"%.*s\"\n",
+                    (int) entry, conf);
+        }
+        conf += entry;
+        if (*conf == ',') {
+            conf++;
+        }
+    }
+}
+
+/*
+ * mm_stats: Copies out the counters kept since mm_init.
+ */
+void mm_stats(mm_stats_t *stats)
+{
+    int i;
+
+    *stats = counters;
+    stats->nbins = SLIST_SIZE;
+    for (i = 0; i < SLIST_SIZE; i++) {
+        stats->bin_limit[i] = i < SLIST_SIZE - 1 ? sList_limits[i] : 0;
+    }
+}
+
+/*
+ * prof_reset: Forgets every sample; the next sampled malloc only draws
+ *             the first interval.
+ */
+static void prof_reset(void)
+{
+    if (prof_stack_count != 0) {
+        memset(prof_live, 0, PROF_LIVE_SLOTS * sizeof(prof_live_t));
+        memset(prof_stacks, 0, PROF_STACK_SLOTS * sizeof(prof_stack_t));
+    }
+    prof_live_count = 0;
+    prof_stack_count = 0;
+    prof_countdown = -1;
+    prof_armed = false;
+}
+
+/*
+ * prof_interval: Draws the bytes until the next sample from an
+ *                exponential distribution with mean prof_sample, so
+ *                that every byte allocated is equally likely to be
+ *                sampled and a block of n bytes is sampled with
+ *                probability 1 - exp(-n / prof_sample), as pprof assumes.
+ */
+static long prof_interval(void)
+{
+    double u;
+
+    prof_rng ^= prof_rng << 13;
+    prof_rng ^= prof_rng >> 7;
+    prof_rng ^= prof_rng << 17;
+    u = ((prof_rng >> 11) + 1) * (1.0 / 9007199254740992.0);   // (0, 1]
+    return (long) (-log(u) * (double) prof_sample);
+}
+
+/*
+ * prof_tables: Maps the sample tables on first use.  Returns false if
+ *              they could not be mapped.
+ */
+static bool prof_tables(void)
+{
+    void *p;
+
+    if (prof_live != NULL) {
+        return true;
+    }
+    p = mmap(NULL, PROF_LIVE_SLOTS * sizeof(prof_live_t) +
+             PROF_STACK_SLOTS * sizeof(prof_stack_t), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    prof_live = p;
+    prof_stacks = (prof_stack_t *) (prof_live + PROF_LIVE_SLOTS);
+    return true;
+}
+
+/*
+ * prof_home: Returns the slot in prof_live where ptr's probe run starts.
+ */
+static size_t prof_home(void *ptr)
+{
+    return (size_t) (((uintptr_t) ptr >> 4) * 0x9e3779b97f4a7c15ULL
+                     >> (64 - PROF_LIVE_BITS));
+}
+
+/*
+ * prof_live_slot: Returns the slot of ptr in prof_live, or the empty slot
+ *                 where it would go.
+ */
+static size_t prof_live_slot(void *ptr)
+{
+    size_t i = prof_home(ptr);
+
+    while (prof_live[i].ptr != NULL && prof_live[i].ptr != ptr) {
+        i = (i + 1) & (PROF_LIVE_SLOTS - 1);
+    }
+    return i;
+}
+
+/*
+ * prof_stack_slot: Returns the slot holding this stack, adding it if it
+ *                  is new, or -1 if the table is full.
+ */
+static int prof_stack_slot(void **frames, int depth)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i;
+    int f;
+
+    for (f = 0; f < depth; f++) {
+        h = (h ^ (uintptr_t) frames[f]) * 0x100000001b3ULL;
+    }
+    for (i = h & (PROF_STACK_SLOTS - 1); prof_stacks[i].depth != 0;
+         i = (i + 1) & (PROF_STACK_SLOTS - 1)) {
+        if (prof_stacks[i].depth == depth &&
+            memcmp(prof_stacks[i].frames, frames, depth * sizeof(void *)) == 0) {
+            return (int) i;
+        }
+    }
+    if (prof_stack_count >= PROF_STACK_SLOTS / 2) {
+        return -1;
+    }
+    prof_stack_count++;
+    prof_stacks[i].depth = depth;
+    memcpy(prof_stacks[i].frames, frames, depth * sizeof(void *));
+    return (int) i;
+}
+
+/*
+ * prof_malloc: Records a sampled block with the stack that allocated it,
+ *              and draws the next interval.  Samples that do not fit in
+ *              the tables are dropped.  Kept out of line so that the
+ *              frame it skips is its own.
+ */
+static void __attribute__((noinline)) prof_malloc(void *bp, size_t size)
+{
+    void *frames[PROF_DEPTH + 1];
+    int depth, s;
+    size_t i;
+
+    prof_countdown = prof_interval();
+    if (!prof_armed) {
+        prof_armed = true;
+        return;
+    }
+    if (prof_busy || !prof_tables() ||
+        prof_live_count >= PROF_LIVE_SLOTS / 2) {
+        return;
+    }
+
+    prof_busy = true;
+    depth = backtrace(frames, PROF_DEPTH + 1);
+    prof_busy = false;
+    if (depth <= 1 || (s = prof_stack_slot(frames + 1, depth - 1)) < 0) {
+        return;
+    }
+
+    i = prof_live_slot(bp);
+    prof_live[i].ptr = bp;
+    prof_live[i].size = size;
+    prof_live[i].stack = s;
+    prof_live_count++;
+    prof_stacks[s].live_count++;
+    prof_stacks[s].live_bytes += size;
+    prof_stacks[s].total_count++;
+    prof_stacks[s].total_bytes += size;
+}
+
+/*
+ * prof_free: Retires bp's sample, if it has one.  Deletion shifts the
+ *            rest of the probe run back so that lookups need no
+ *            tombstones.
+ */
+static void prof_free(void *bp)
+{
+    size_t i = prof_live_slot(bp), j, home;
+    prof_stack_t *st;
+
+    if (prof_live[i].ptr == NULL) {
+        return;
+    }
+    st = &prof_stacks[prof_live[i].stack];
+    st->live_count--;
+    st->live_bytes -= prof_live[i].size;
+    prof_live_count--;
+
+    for (j = (i + 1) & (PROF_LIVE_SLOTS - 1); prof_live[j].ptr != NULL;
+         j = (j + 1) & (PROF_LIVE_SLOTS - 1)) {
+        home = prof_home(prof_live[j].ptr);
+        // Move j into the hole at i unless its home lies in (i, j]
+        if (((j - home) & (PROF_LIVE_SLOTS - 1)) >=
+            ((j - i) & (PROF_LIVE_SLOTS - 1))) {
+            prof_live[i] = prof_live[j];
+            i = j;
+        }
+    }
+    prof_live[i].ptr = NULL;
+}
+
+/*
+ * write_all: Writes all of buf to fd.  Returns false on error.
+ */
+static bool write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+/*
+ * mm_prof_dump: Writes the sampled live and cumulative heap profile to
+ *               fd in the heap_v2 text format that pprof reads, followed
+ *               by the memory map it symbolizes with.  Counts are raw
+ *               samples; pprof scales them up by the sampling interval in
+ *               the header.  Uses no heap memory, so it can be called from
+ *               anywhere.  Returns 0, or -1 on a write error.
+ */
+int mm_prof_dump(int fd)
+{
+    char line[64 + PROF_DEPTH * 20];
+    size_t live_count = 0, live_bytes = 0, total_count = 0, total_bytes = 0;
+    size_t i;
+    ssize_t n;
+    int f, maps, len;
+
+    for (i = 0; prof_stack_count != 0 && i < PROF_STACK_SLOTS; i++) {
+        live_count += prof_stacks[i].live_count;
+        live_bytes += prof_stacks[i].live_bytes;
+        total_count += prof_stacks[i].total_count;
+        total_bytes += prof_stacks[i].total_bytes;
+    }
+    len = snprintf(line, sizeof(line),
+                   "heap profile: %6zu: %8zu [%6zu: %8zu] @ heap_v2/%zu\n",
+                   live_count, live_bytes, total_count, total_bytes,
+                   prof_sample);
+    if (!write_all(fd, line, len)) {
+        return -1;
+    }
+
+    for (i = 0; prof_stack_count != 0 && i < PROF_STACK_SLOTS; i++) {
+        const prof_stack_t *st = &prof_stacks[i];
+        if (st->depth == 0) {
+            continue;
+        }
+        len = snprintf(line, sizeof(line), "%6zu: %8zu [%6zu: %8zu] @",
+                       st->live_count, st->live_bytes,
+                       st->total_count, st->total_bytes);
+        if (!write_all(fd, line, len)) {
+            return -1;
+        }
+        /* One write per frame, so no counter or address can overrun line */
+        for (f = 0; f < st->depth; f++) {
+            len = snprintf(line, sizeof(line), " %p", st->frames[f]);
+            if (!write_all(fd, line, len)) {
+                return -1;
+            }
+        }
+        if (!write_all(fd, "\n", 1)) {
+            return -1;
+        }
+    }
+
+    if (!write_all(fd, "\nMAPPED_LIBRARIES:\n", 19)) {
+        return -1;
+    }
+    if ((maps = open("/proc/self/maps", O_RDONLY)) < 0) {
+        return 0;
+    }
+    while ((n = read(maps, line, sizeof(line))) > 0) {
+        if (!write_all(fd, line, (size_t) n)) {
+            close(maps);
+            return -1;
+        }
+    }
+    close(maps);
+    return 0;
+}
+
+#if defined(MM_TRACE) || defined(MM_CYCLES)
+/*
+ * read_clock: Reads the timestamp counter, or the monotonic clock in
+ *             nanoseconds where there is none.
+ */
+static uint64_t read_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+#endif
+}
+#endif
+
+#ifdef MM_TRACE
+static uint64_t trace_clock(void)
+{
+    return read_clock();
+}
+
+/*
+ * trace_event: Appends an event that began at start to the ring,
+ *              overwriting the oldest once it is full.
+ */
+static void trace_event(int op, uint64_t start, const void *addr,
+                        const void *old, size_t size, int bin, size_t search)
+{
+    mm_event_t *ev;
+
+    if (trace_ring == NULL) {
+        void *p = mmap(NULL, MM_TRACE_EVENTS * sizeof(mm_event_t),
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) {
+            return;
+        }
+        trace_ring = p;
+        trace_tick0 = trace_clock();
+        clock_gettime(CLOCK_MONOTONIC, &trace_time0);
+    }
+    ev = &trace_ring[trace_count++ & (MM_TRACE_EVENTS - 1)];
+    ev->start = start;
+    ev->ticks = (uint32_t) (trace_clock() - start);
+    ev->op = (uint8_t) op;
+    ev->flags = trace_nesting > 0 && op != MM_EV_REALLOC ? MM_EV_NESTED : 0;
+    ev->bin = (int16_t) bin;
+    ev->addr = (uintptr_t) addr;
+    ev->old = (uintptr_t) old;
+    ev->size = size;
+    ev->search = search;
+}
+
+/*
+ * mm_trace_dump: Writes the events in the ring, oldest first, after a
+ *                header giving the timestamp rate measured since the ring
+ *                was mapped.  Uses no heap memory.  Returns 0, or -1 on a
+ *                write error.
+ */
+int mm_trace_dump(int fd)
+{
+    mm_event_header_t hdr;
+    struct timespec now;
+    uint64_t first;
+    double secs;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MM_EVENT_MAGIC, sizeof(hdr.magic));
+    hdr.count = trace_count < MM_TRACE_EVENTS ? trace_count : MM_TRACE_EVENTS;
+    hdr.dropped = trace_count - hdr.count;
+    hdr.ticks_per_sec = 1e9;
+    if (trace_ring != NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        secs = (now.tv_sec - trace_time0.tv_sec) +
+               (now.tv_nsec - trace_time0.tv_nsec) * 1e-9;
+        if (secs > 0) {
+            hdr.ticks_per_sec = (trace_clock() - trace_tick0) / secs;
+        }
+    }
+    if (!write_all(fd, (const char *) &hdr, sizeof(hdr))) {
+        return -1;
+    }
+
+    // The ring holds count events ending at trace_count, possibly wrapped
+    first = (trace_count - hdr.count) & (MM_TRACE_EVENTS - 1);
+    if (first + hdr.count > MM_TRACE_EVENTS) {
+        size_t tail = MM_TRACE_EVENTS - first;
+        if (!write_all(fd, (const char *) &trace_ring[first],
+                        tail * sizeof(mm_event_t)) ||
+            !write_all(fd, (const char *) trace_ring,
+                        (hdr.count - tail) * sizeof(mm_event_t))) {
+            return -1;
+        }
+    } else if (hdr.count > 0 &&
+               !write_all(fd, (const char *) &trace_ring[first],
+                           hdr.count * sizeof(mm_event_t))) {
+        return -1;
+    }
+    return 0;
+}
+#else
+static inline uint64_t trace_clock(void)
+{
+    return 0;
+}
+
+static inline void trace_event(int op, uint64_t start, const void *addr,
+                               const void *old, size_t size, int bin,
+                               size_t search)
+{
+}
+
+/*
+ * mm_trace_dump: Tracing is not compiled in.
+ */
+int mm_trace_dump(int fd)
+{
+    return -1;
+}
+#endif /* MM_TRACE */
+
+#ifdef MM_CYCLES
+/*
+ * cyc_reset: Clears the counts, and estimates what timing one call
+ *            costs as the least gap between two clock reads.
+ */
+static void cyc_reset(void)
+{
+    uint64_t best = UINT64_MAX, t0, t1;
+    int i;
+
+    memset(&cycle_counts, 0, sizeof(cycle_counts));
+    cyc_depth = 0;
+    for (i = 0; i < 100; i++) {
+        t0 = read_clock();
+        t1 = read_clock();
+        if (t1 - t0 < best) {
+            best = t1 - t0;
+        }
+    }
+    cycle_counts.overhead = best;
+}
+
+/*
+ * cyc_enter: Opens a timed call and returns its start time.
+ */
+static uint64_t cyc_enter(void)
+{
+    if (cyc_depth < CYC_MAX_DEPTH) {
+        cyc_child[cyc_depth] = 0;
+    }
+    cyc_depth++;
+    return read_clock();
+}
+
+/*
+ * cyc_exit: Closes the innermost timed call, a call to fn, charging it
+ *           the time since start less what its callees took, and
+ *           charging the whole of it to its caller's callees.
+ */
+static void cyc_exit(mm_fn_t fn, uint64_t start)
+{
+    uint64_t elapsed = read_clock() - start;
+
+    cyc_depth--;
+    cycle_counts.calls[fn]++;
+    cycle_counts.cycles[fn] += elapsed;
+    cycle_counts.self[fn] += elapsed -
+        (cyc_depth < CYC_MAX_DEPTH ? cyc_child[cyc_depth] : 0);
+    if (cyc_depth > 0 && cyc_depth <= CYC_MAX_DEPTH) {
+        cyc_child[cyc_depth - 1] += elapsed;
+    }
+}
+
+/*
+ * mm_cycles: Copies out the counts kept since mm_init.
+ */
+int mm_cycles(mm_cycles_t *cycles)
+{
+    *cycles = cycle_counts;
+    return 0;
+}
+#else
+static inline uint64_t cyc_enter(void)
+{
+    return 0;
+}
+
+static inline void cyc_exit(mm_fn_t fn, uint64_t start)
+{
+}
+
+/*
+ * mm_cycles: Cycle accounting is not compiled in.
+ */
+int mm_cycles(mm_cycles_t *cycles)
+{
+    return -1;
+}
+#endif /* MM_CYCLES */
+
+/*
+ * mm_heap_dump: Writes a snapshot of the heap: a header, then every
+ *               block in address order with its offset from the start of
+ *               the heap, size, allocation bit, and free list.  Uses no
+ *               heap memory.  Returns 0, or -1 on a write error.
+ */
+int mm_heap_dump(int fd)
+{
+    mm_heap_header_t hdr;
+    mm_heap_block_t buf[256];
+    block_t *block;
+    size_t n = 0;
+    int i;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MM_HEAP_MAGIC, sizeof(hdr.magic));
+    hdr.heap_bytes = mem_heapsize();
+    hdr.nbins = SLIST_SIZE;
+    for (i = 0; i < SLIST_SIZE; i++) {
+        hdr.bin_limit[i] = i < SLIST_SIZE - 1 ? sList_limits[i] : 0;
+    }
+    for (block = heap_start; block != NULL && get_size(block) > 0;
+         block = find_next(block)) {
+        hdr.nblocks++;
+    }
+    if (!write_all(fd, (const char *) &hdr, sizeof(hdr))) {
+        return -1;
+    }
+
+    memset(buf, 0, sizeof(buf));
+    for (block = heap_start; block != NULL && get_size(block) > 0;
+         block = find_next(block)) {
+        mm_heap_block_t *b = &buf[n++];
+        b->offset = (uintptr_t) block - (uintptr_t) mem_heap_lo();
+        b->size = get_size(block);
+        b->alloc = get_alloc(block);
+        b->bin = b->alloc ? -1 : block_to_sList(block);
+        if (n == sizeof(buf) / sizeof(buf[0])) {
+            if (!write_all(fd, (const char *) buf, sizeof(buf))) {
+                return -1;
+            }
+            n = 0;
+        }
+    }
+    if (n > 0 && !write_all(fd, (const char *) buf, n * sizeof(buf[0]))) {
+        return -1;
+    }
+    return 0;
+}
+
 /*
  * max: returns x if x > y, and y otherwise.
  */
@@ -1031,23 +1902,13 @@ static void *header_to_payload(block_t *block)
  *                list that would be associated with it.
  */
 static int size_to_sList(size_t size) {
-  if(size == SIZE_1) {
-    return 0;
-  } else if(size > SIZE_1 && size <= SIZE_2) {
-    return 1;
-  } else if(size > SIZE_2 && size <= SIZE_3) {
-    return 2;
-  } else if(size > SIZE_3 && size <= SIZE_4) {
-    return 3;
-  } else if(size > SIZE_4 && size <= SIZE_5) {
-    return 4;
-  } else if(size > SIZE_5 && size <= SIZE_6) {
-    return 5;
-  } else if(size > SIZE_6) {
-    return 6;
-  } else {
-    return 0;
+  int i;
+  for(i = 0; i < SLIST_SIZE - 1; i++) {
+    if(size <= sList_limits[i]) {
+      return i;
+    }
   }
+  return SLIST_SIZE - 1;
 }
 
 /*
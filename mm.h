@@ -1,5 +1,9 @@
+#ifndef __MM_H_
+#define __MM_H_
+
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef DRIVER
 
@@ -21,5 +25,160 @@ extern void *calloc (size_t nmemb, size_t size);
 
 extern bool mm_init(void);
 
+/* Free-space summary, sampled by the driver's fragmentation timeline */
+#define MM_MAX_BINS 16
+
+typedef struct {
+    int nbins;                       /* number of free-list bins in use */
+    size_t bin_limit[MM_MAX_BINS];   /* largest block size per bin, 0 = no limit */
+    size_t free_bytes[MM_MAX_BINS];  /* bytes in the free blocks of each bin */
+    size_t free_blocks[MM_MAX_BINS]; /* number of free blocks in each bin */
+    size_t largest_free;             /* size of the largest free block */
+} mm_freeinfo_t;
+
+extern void mm_freeinfo(mm_freeinfo_t *info);
+
+/*
+ * Counters kept on every call, cheap enough to leave on in production.
+ * mm.c serves one thread, so they are plain globals; mm_init resets them.
+ * The stats tunable turns off the call and search counts; the byte and
+ * block counts are always kept, since they could not be right again
+ * once turned back on.
+ */
+typedef struct {
+    size_t heap_bytes;               /* bytes taken from mem_sbrk */
+    size_t alloc_bytes;              /* bytes in allocated blocks, headers included */
+    size_t alloc_blocks;             /* number of allocated blocks */
+    int nbins;                       /* number of free-list bins in use */
+    size_t bin_limit[MM_MAX_BINS];   /* largest block size per bin, 0 = no limit */
+    size_t free_bytes[MM_MAX_BINS];  /* bytes in the free blocks of each bin */
+    size_t free_blocks[MM_MAX_BINS]; /* number of free blocks in each bin */
+    size_t mallocs, frees, reallocs; /* calls, including realloc's own */
+    size_t realloc_inplace;          /* reallocs that kept their block;
+                                        mm.c always moves, so always 0 */
+    size_t realloc_copy;             /* reallocs that moved the payload */
+    size_t extend_calls;             /* times the heap grew */
+    size_t fit_calls;                /* free-list searches */
+    size_t fit_probes;               /* free blocks those searches examined */
+    size_t fit_misses;               /* searches that found no block */
+} mm_stats_t;
+
+extern void mm_stats(mm_stats_t *stats);
+
+/*
+ * Run-time tunables.  mm_ctl reads the named tunable into *oldp and sets
+ * it from *newp (either may be NULL), and returns 0, or -1 for an unknown
+ * name or a bad value.  The first mm_init also applies any settings in
+ * the MM_CONF environment variable, e.g. MM_CONF=fit_depth:8,chunk_size:16384
+ *
+ *   fit_depth    free blocks that fit which malloc weighs before taking
+ *                the smallest (default N_SIZE)
+ *   chunk_size   least the heap grows by, a multiple of 16 (default CHUNKSIZE)
+ *   prof_sample  mean bytes allocated between heap profile samples,
+ *                0 = profiler off (default 0)
+ *   stats        1 = count calls and free-list searches for mm_stats,
+ *                0 = leave those counts as they are (default 1)
+ */
+extern int mm_ctl(const char *name, size_t *oldp, const size_t *newp);
+
+/*
+ * Heap profile.  With prof_sample set, malloc samples blocks at random,
+ * about one per prof_sample bytes, and records the stack that allocated
+ * each one until it is freed.  mm_prof_dump writes the samples still live
+ * and all samples since mm_init, per stack, in pprof's heap_v2 text
+ * format, e.g. "pprof --inuse_space mdriver bdd-aa4.heap".  Returns 0, or
+ * -1 on a write error.
+ */
+extern int mm_prof_dump(int fd);
+
+/*
+ * Event trace.  mm.c built with -DMM_TRACE ("make MMTRACE=1") keeps its
+ * last MM_TRACE_EVENTS events since mm_init in a ring, at the cost of
+ * two timestamp reads per call.  mm_trace_dump writes an
+ * mm_event_header_t and then the events, oldest first, for mmevents to
+ * summarize or turn into a .rep trace or a Chrome trace.  Returns 0, or
+ * -1 on a write error or if tracing is not compiled in.
+ */
+#define MM_EVENT_MAGIC "MMEVENT1"
+
+typedef enum {
+    MM_EV_MALLOC, MM_EV_FREE, MM_EV_REALLOC, MM_EV_EXTEND, MM_EV_COALESCE
+} mm_event_op_t;
+
+#define MM_EV_NESTED 0x1     /* a malloc or free made by realloc itself */
+
+typedef struct {
+    uint64_t start;          /* timestamp at entry, in ticks */
+    uint32_t ticks;          /* time taken */
+    uint8_t op;              /* mm_event_op_t */
+    uint8_t flags;           /* MM_EV_NESTED */
+    int16_t bin;             /* free list searched or filled, -1 if none */
+    uint64_t addr;           /* payload, or block for extend and coalesce */
+    uint64_t old;            /* realloc: the old payload */
+    uint64_t size;           /* bytes requested, or block size */
+    uint64_t search;         /* free blocks malloc examined */
+} mm_event_t;
+
+typedef struct {
+    char magic[8];           /* MM_EVENT_MAGIC */
+    uint64_t count;          /* events that follow */
+    uint64_t dropped;        /* older events the ring overwrote */
+    double ticks_per_sec;    /* timestamp rate */
+} mm_event_header_t;
+
+extern int mm_trace_dump(int fd);
+
+/*
+ * Cycle accounting.  mm.c built with -DMM_CYCLES ("make MMCYCLES=1")
+ * counts the calls to each of its main routines and the timestamp ticks
+ * they take, both in all (cycles) and less the time in the routines
+ * listed here that they call (self).  Each timed call also pays about
+ * overhead ticks for the timing itself.  mm_cycles copies out the counts
+ * since mm_init, and returns 0, or -1 if accounting is not compiled in.
+ */
+typedef enum {
+    MM_FN_MALLOC, MM_FN_FREE, MM_FN_REALLOC, MM_FN_FIND_FIT, MM_FN_PLACE,
+    MM_FN_COALESCE, MM_FN_ADD_FREE, MM_FN_REMOVE_FREE, MM_FN_EXTEND_HEAP,
+    MM_NUM_FNS
+} mm_fn_t;
+
+typedef struct {
+    uint64_t calls[MM_NUM_FNS];
+    uint64_t cycles[MM_NUM_FNS];     /* ticks, callees included */
+    uint64_t self[MM_NUM_FNS];       /* ticks, callees excluded */
+    uint64_t overhead;               /* ticks one clock read costs */
+} mm_cycles_t;
+
+extern int mm_cycles(mm_cycles_t *cycles);
+
+/*
+ * Heap snapshot.  mm_heap_dump writes an mm_heap_header_t and then an
+ * mm_heap_block_t for every block, in address order, for mmheap to
+ * render as a map and measure fragmentation on.  Returns 0, or -1 on a
+ * write error.
+ */
+#define MM_HEAP_MAGIC "MMHEAP01"
+
+typedef struct {
+    char magic[8];                   /* MM_HEAP_MAGIC */
+    uint64_t heap_bytes;             /* bytes taken from mem_sbrk */
+    uint64_t nblocks;                /* blocks that follow */
+    int32_t nbins;                   /* number of free-list bins */
+    int32_t reserved;
+    uint64_t bin_limit[MM_MAX_BINS]; /* largest block size per bin, 0 = no limit */
+} mm_heap_header_t;
+
+typedef struct {
+    uint64_t offset;                 /* of the header, from the heap's start */
+    uint64_t size;                   /* block size, header included */
+    uint8_t alloc;                   /* 1 if allocated */
+    int8_t bin;                      /* free list it is on, -1 if allocated */
+    uint8_t reserved[6];
+} mm_heap_block_t;
+
+extern int mm_heap_dump(int fd);
+
 /* This is for debugging.  Returns false if error encountered */
 extern bool mm_checkheap(int lineno);
+
+#endif /* __MM_H_ */
@@ -0,0 +1,334 @@
+/*
+ * mmevents.c - Summarize and convert mm.c's event traces
+ *
+ * mm.c built with "make MMTRACE=1" records its last malloc, free,
+ * realloc, heap extension and coalesce events, each with its start time,
+ * duration, size, address, free list and search length, and
+ * "mdriver --events" dumps them to <trace>.events.  By default this
+ * prints, for each kind of event, how many there were and how long they
+ * took, then the slowest events, which is where latency spikes show up.
+ *
+ *   -r <rep>    Write the top-level mallocs, frees and reallocs as a .rep
+ *               trace, to replay the run through mdriver or any tool.
+ *               A ring that wrapped starts mid-run: frees and reallocs
+ *               of blocks allocated before it are dropped or made allocs
+ *   -c <json>   Write a Chrome trace (chrome://tracing, Perfetto), with
+ *               the heap size as a counter
+ *   -n <k>      Slowest events to list (default 10)
+ *
+ * Usage: mmevents [-r <rep>] [-c <json>] [-n <k>] <events>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "tracefile.h"
+#include "json.h"
+
+#define DEFAULT_SLOWEST 10
+#define NUM_OPS (MM_EV_COALESCE + 1)
+
+static const char *op_names[NUM_OPS] = {
+    "malloc", "free", "realloc", "extend", "coalesce"
+};
+
+typedef struct {
+    mm_event_header_t hdr;
+    mm_event_t *ev;
+} events_t;
+
+/* Address to block id, for rebuilding a trace; ids stay in the table */
+typedef struct {
+    uint64_t *addr;         /* 0 = empty */
+    long *id;
+    size_t mask;
+} idmap_t;
+
+static void fatal(const char *msg, const char *arg)
+{
+    fprintf(stderr, "mmevents: %s%s\n", msg, arg);
+    exit(1);
+}
+
+static void read_events(const char *path, events_t *e)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL)
+        fatal("could not open ", path);
+    if (fread(&e->hdr, sizeof(e->hdr), 1, fp) != 1 ||
+        memcmp(e->hdr.magic, MM_EVENT_MAGIC, sizeof(e->hdr.magic)) != 0)
+        fatal("not an event trace: ", path);
+    e->ev = malloc((e->hdr.count + 1) * sizeof(mm_event_t));
+    if (e->ev == NULL)
+        fatal("out of memory reading ", path);
+    if (fread(e->ev, sizeof(mm_event_t), e->hdr.count, fp) != e->hdr.count)
+        fatal("truncated event trace: ", path);
+    fclose(fp);
+}
+
+static double ns(const events_t *e, uint64_t ticks)
+{
+    return ticks * 1e9 / e->hdr.ticks_per_sec;
+}
+
+static int by_ticks(const void *a, const void *b)
+{
+    const mm_event_t *x = *(const mm_event_t * const *) a;
+    const mm_event_t *y = *(const mm_event_t * const *) b;
+    return (x->ticks < y->ticks) - (x->ticks > y->ticks);
+}
+
+static void summarize(const events_t *e, int slowest)
+{
+    uint64_t count[NUM_OPS] = {0}, total[NUM_OPS] = {0}, worst[NUM_OPS] = {0};
+    uint64_t search = 0, i;
+    const mm_event_t **order;
+    int op, k;
+
+    for (i = 0; i < e->hdr.count; i++) {
+        const mm_event_t *ev = &e->ev[i];
+        if (ev->op >= NUM_OPS)
+            continue;
+        count[ev->op]++;
+        total[ev->op] += ev->ticks;
+        if (ev->ticks > worst[ev->op])
+            worst[ev->op] = ev->ticks;
+        if (ev->op == MM_EV_MALLOC)
+            search += ev->search;
+    }
+    printf("%llu events, %llu older ones overwritten, %.0f ticks/sec\n\n",
+           (unsigned long long) e->hdr.count,
+           (unsigned long long) e->hdr.dropped, e->hdr.ticks_per_sec);
+    printf("%-10s%10s%12s%12s\n", "event", "count", "mean ns", "max ns");
+    for (op = 0; op < NUM_OPS; op++) {
+        if (count[op] == 0)
+            continue;
+        printf("%-10s%10llu%12.1f%12.1f\n", op_names[op],
+               (unsigned long long) count[op],
+               ns(e, total[op]) / count[op], ns(e, worst[op]));
+    }
+    if (count[MM_EV_MALLOC])
+        printf("\nmalloc examined %.2f free blocks on average\n",
+               (double) search / count[MM_EV_MALLOC]);
+
+    if (slowest <= 0 || e->hdr.count == 0)
+        return;
+    order = malloc(e->hdr.count * sizeof(*order));
+    if (order == NULL)
+        fatal("out of memory", "");
+    for (i = 0; i < e->hdr.count; i++)
+        order[i] = &e->ev[i];
+    qsort(order, e->hdr.count, sizeof(*order), by_ticks);
+    printf("\nslowest events:\n%10s  %-10s%10s%12s%5s%8s  %s\n", "event#",
+           "event", "ns", "size", "bin", "search", "address");
+    for (k = 0; k < slowest && (uint64_t) k < e->hdr.count; k++) {
+        const mm_event_t *ev = order[k];
+        printf("%10ld  %-10s%10.1f%12llu%5d%8llu  0x%llx\n",
+               (long) (ev - e->ev), ev->op < NUM_OPS ? op_names[ev->op] : "?",
+               ns(e, ev->ticks), (unsigned long long) ev->size, ev->bin,
+               (unsigned long long) ev->search, (unsigned long long) ev->addr);
+    }
+    free(order);
+}
+
+static size_t idmap_slot(const idmap_t *m, uint64_t addr)
+{
+    size_t i = (size_t) ((addr >> 4) * 0x9e3779b97f4a7c15ULL) & m->mask;
+
+    while (m->addr[i] != 0 && m->addr[i] != addr)
+        i = (i + 1) & m->mask;
+    return i;
+}
+
+/* The live block id at addr, or -1; marks it freed */
+static long idmap_take(idmap_t *m, uint64_t addr)
+{
+    size_t i = idmap_slot(m, addr);
+    long id = m->addr[i] == addr ? m->id[i] : -1;
+
+    if (id >= 0)
+        m->id[i] = -1;
+    return id;
+}
+
+static void idmap_put(idmap_t *m, uint64_t addr, long id)
+{
+    size_t i = idmap_slot(m, addr);
+    m->addr[i] = addr;
+    m->id[i] = id;
+}
+
+static void add_op(tf_trace_t *t, tf_type_t type, long id, size_t size)
+{
+    t->ops[t->num_ops].type = type;
+    t->ops[t->num_ops].index = id;
+    t->ops[t->num_ops].size = size;
+    t->num_ops++;
+}
+
+/*
+ * write_rep - Rebuild the requests the driver made from the top-level
+ *     events.  Block ids follow allocation order; a freed address that
+ *     comes back later gets a new id.
+ */
+static void write_rep(const events_t *e, const char *path)
+{
+    tf_trace_t t;
+    idmap_t m;
+    size_t *sizes, live = 0, n = 16;
+    uint64_t i;
+
+    while (n < 2 * e->hdr.count)
+        n *= 2;
+    m.mask = n - 1;
+    m.addr = calloc(n, sizeof(uint64_t));
+    m.id = calloc(n, sizeof(long));
+    memset(&t, 0, sizeof(t));
+    t.weight = 1;
+    t.ops = calloc(e->hdr.count + 1, sizeof(tf_op_t));
+    sizes = calloc(e->hdr.count + 1, sizeof(size_t));
+    if (!m.addr || !m.id || !t.ops || !sizes)
+        fatal("out of memory converting to ", path);
+
+    for (i = 0; i < e->hdr.count; i++) {
+        const mm_event_t *ev = &e->ev[i];
+        long id;
+
+        if (ev->flags & MM_EV_NESTED)
+            continue;
+        switch (ev->op) {
+        case MM_EV_MALLOC:
+            id = t.num_ids++;
+            idmap_put(&m, ev->addr, id);
+            add_op(&t, TF_ALLOC, id, ev->size);
+            break;
+        case MM_EV_FREE:
+            if (ev->addr == 0 || (id = idmap_take(&m, ev->addr)) < 0)
+                continue;
+            add_op(&t, TF_FREE, id, 0);
+            break;
+        case MM_EV_REALLOC:
+            id = ev->old ? idmap_take(&m, ev->old) : -1;
+            if (ev->size == 0) {
+                if (id < 0)
+                    continue;
+                add_op(&t, TF_FREE, id, 0);
+                break;
+            }
+            if (id < 0) {
+                id = t.num_ids++;
+                add_op(&t, TF_ALLOC, id, ev->size);
+            } else {
+                add_op(&t, TF_REALLOC, id, ev->size);
+            }
+            idmap_put(&m, ev->addr, id);
+            break;
+        default:
+            continue;
+        }
+
+        /* Track the live payload for the header's data_bytes */
+        id = t.ops[t.num_ops - 1].index;
+        live -= sizes[id];
+        sizes[id] = t.ops[t.num_ops - 1].size;
+        live += sizes[id];
+        if (live > t.data_bytes)
+            t.data_bytes = live;
+    }
+    if (tf_write_text(&t, path) < 0)
+        fatal("could not write ", path);
+    printf("wrote %d requests on %d blocks to %s\n", t.num_ops, t.num_ids, path);
+    free(sizes);
+    free(t.ops);
+    free(m.addr);
+    free(m.id);
+}
+
+/*
+ * write_chrome - Every event as a complete ("X") event on one thread,
+ *     with times in microseconds from the first event, and the heap size
+ *     as a counter that steps at each extension
+ */
+static void write_chrome(const events_t *e, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    uint64_t base = e->hdr.count ? e->ev[0].start : 0, heap = 0, i;
+    double us = 1e6 / e->hdr.ticks_per_sec;
+
+    if (fp == NULL)
+        fatal("could not create ", path);
+    fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    for (i = 0; i < e->hdr.count; i++) {
+        const mm_event_t *ev = &e->ev[i];
+        double ts = (double) (int64_t) (ev->start - base) * us;
+
+        fprintf(fp, "%s{\"name\": ", i ? ",\n" : "");
+        json_write_string(fp, ev->op < NUM_OPS ? op_names[ev->op] : "?");
+        fprintf(fp, ", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, "
+                "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"size\": %llu, "
+                "\"addr\": \"0x%llx\", \"bin\": %d, \"search\": %llu",
+                ts, ev->ticks * us, (unsigned long long) ev->size,
+                (unsigned long long) ev->addr, ev->bin,
+                (unsigned long long) ev->search);
+        if (ev->op == MM_EV_REALLOC)
+            fprintf(fp, ", \"old\": \"0x%llx\"", (unsigned long long) ev->old);
+        fprintf(fp, "}}");
+        if (ev->op == MM_EV_EXTEND) {
+            heap += ev->size;
+            fprintf(fp, ",\n{\"name\": \"heap\", \"ph\": \"C\", \"pid\": 1, "
+                    "\"ts\": %.3f, \"args\": {\"bytes\": %llu}}",
+                    ts, (unsigned long long) heap);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    if (fclose(fp) != 0)
+        fatal("could not write ", path);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-r <rep>] [-c <json>] [-n <k>] <events>\n", prog);
+    fprintf(stderr, "\t-r <rep>   Write the mallocs, frees and reallocs as a trace\n");
+    fprintf(stderr, "\t-c <json>  Write a Chrome trace\n");
+    fprintf(stderr, "\t-n <k>     Slowest events to list (default %d)\n",
+            DEFAULT_SLOWEST);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *rep = NULL, *chrome = NULL;
+    int slowest = DEFAULT_SLOWEST, c;
+    events_t e;
+
+    while ((c = getopt(argc, argv, "r:c:n:h")) != EOF) {
+        switch (c) {
+        case 'r':
+            rep = optarg;
+            break;
+        case 'c':
+            chrome = optarg;
+            break;
+        case 'n':
+            slowest = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    read_events(argv[optind], &e);
+    summarize(&e, slowest);
+    if (rep)
+        write_rep(&e, rep);
+    if (chrome)
+        write_chrome(&e, chrome);
+    free(e.ev);
+    return 0;
+}
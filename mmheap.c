@@ -0,0 +1,315 @@
+/*
+ * mmheap.c - Render mm.c's heap snapshots and measure fragmentation
+ *
+ * "mdriver --heap-map" writes <trace>.heapmap, a snapshot of every
+ * block in mm.c's heap at the trace's peak (mm_heap_dump).  This prints
+ *
+ *   - heap, allocated and free bytes and blocks, and the largest free
+ *     block, with external fragmentation 1 - largest free / free
+ *   - stranded bytes: free blocks with allocated blocks on both sides,
+ *     which only a request that fits them can use, as against a free
+ *     block at the top of the heap, which the next extension grows
+ *   - the free blocks by power-of-two size class and by free list
+ *
+ * and with -s draws the heap as an SVG map, one row per -b * -w bytes,
+ * allocated blocks in blue and free blocks shaded by free list, each
+ * with its offset, size and list on hover.
+ *
+ * Usage: mmheap [-s <svg>] [-w <pixels>] [-b <bytes/pixel>] <heapmap>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "mm.h"
+
+#define DEFAULT_WIDTH 1024
+#define MAX_ROWS 256            /* default -b fits the heap in this many rows */
+#define ROW_HEIGHT 12
+#define ROW_GAP 2
+#define TOP 44                  /* room for the title */
+#define NUM_CLASSES 48
+
+static const char *alloc_fill[2] = { "#4c72b0", "#6f8fc7" };
+static const char *free_fill[] = {
+    "#fdd49e", "#fdbb84", "#fc8d59", "#ef6548", "#d7301f", "#b30000",
+    "#7f0000"
+};
+#define NUM_FREE_FILLS ((int) (sizeof(free_fill) / sizeof(free_fill[0])))
+
+typedef struct {
+    mm_heap_header_t hdr;
+    mm_heap_block_t *blocks;
+} heapmap_t;
+
+typedef struct {
+    uint64_t alloc_bytes, alloc_blocks;
+    uint64_t free_bytes, free_blocks, largest_free;
+    uint64_t stranded_bytes, stranded_blocks;
+    uint64_t top_free;          /* free bytes at the top of the heap */
+    uint64_t class_blocks[NUM_CLASSES], class_bytes[NUM_CLASSES];
+    uint64_t bin_blocks[MM_MAX_BINS], bin_bytes[MM_MAX_BINS];
+} frag_t;
+
+static void fatal(const char *msg, const char *arg)
+{
+    fprintf(stderr, "mmheap: %s%s\n", msg, arg);
+    exit(1);
+}
+
+static void read_heapmap(const char *path, heapmap_t *h)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL)
+        fatal("could not open ", path);
+    if (fread(&h->hdr, sizeof(h->hdr), 1, fp) != 1 ||
+        memcmp(h->hdr.magic, MM_HEAP_MAGIC, sizeof(h->hdr.magic)) != 0 ||
+        h->hdr.nbins < 0 || h->hdr.nbins > MM_MAX_BINS)
+        fatal("not a heap map: ", path);
+    h->blocks = malloc((h->hdr.nblocks + 1) * sizeof(mm_heap_block_t));
+    if (h->blocks == NULL)
+        fatal("out of memory reading ", path);
+    if (fread(h->blocks, sizeof(mm_heap_block_t), h->hdr.nblocks, fp) !=
+        h->hdr.nblocks)
+        fatal("truncated heap map: ", path);
+    fclose(fp);
+}
+
+/* Power-of-two class of size: class c holds sizes in [2^c, 2^(c+1)) */
+static int size_class(uint64_t size)
+{
+    int c = 0;
+    while (c < NUM_CLASSES - 1 && (size >> (c + 1)) != 0)
+        c++;
+    return c;
+}
+
+static void measure(const heapmap_t *h, frag_t *f)
+{
+    uint64_t i;
+
+    memset(f, 0, sizeof(*f));
+    for (i = 0; i < h->hdr.nblocks; i++) {
+        const mm_heap_block_t *b = &h->blocks[i];
+        int c;
+
+        if (b->alloc) {
+            f->alloc_bytes += b->size;
+            f->alloc_blocks++;
+            continue;
+        }
+        f->free_bytes += b->size;
+        f->free_blocks++;
+        if (b->size > f->largest_free)
+            f->largest_free = b->size;
+        c = size_class(b->size);
+        f->class_blocks[c]++;
+        f->class_bytes[c] += b->size;
+        if (b->bin >= 0 && b->bin < MM_MAX_BINS) {
+            f->bin_blocks[b->bin]++;
+            f->bin_bytes[b->bin] += b->size;
+        }
+        /* Coalescing leaves no two free blocks side by side, and the
+           prologue is allocated, so any but the last is stranded */
+        if (i + 1 == h->hdr.nblocks) {
+            f->top_free = b->size;
+        } else {
+            f->stranded_bytes += b->size;
+            f->stranded_blocks++;
+        }
+    }
+}
+
+static double pct(uint64_t part, uint64_t whole)
+{
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+static void report(const char *path, const heapmap_t *h, const frag_t *f)
+{
+    int c, b;
+
+    printf("%s\n", path);
+    printf("  heap         %12llu bytes %8llu blocks\n",
+           (unsigned long long) h->hdr.heap_bytes,
+           (unsigned long long) h->hdr.nblocks);
+    printf("  allocated    %12llu bytes %8llu blocks  %5.1f%% of heap\n",
+           (unsigned long long) f->alloc_bytes,
+           (unsigned long long) f->alloc_blocks,
+           pct(f->alloc_bytes, h->hdr.heap_bytes));
+    printf("  free         %12llu bytes %8llu blocks  %5.1f%% of heap\n",
+           (unsigned long long) f->free_bytes,
+           (unsigned long long) f->free_blocks,
+           pct(f->free_bytes, h->hdr.heap_bytes));
+    printf("  stranded     %12llu bytes %8llu blocks  %5.1f%% of free\n",
+           (unsigned long long) f->stranded_bytes,
+           (unsigned long long) f->stranded_blocks,
+           pct(f->stranded_bytes, f->free_bytes));
+    printf("  top of heap  %12llu bytes\n", (unsigned long long) f->top_free);
+    printf("  largest free %12llu bytes\n",
+           (unsigned long long) f->largest_free);
+    printf("  external fragmentation %.1f%%\n",
+           f->free_bytes ? 100.0 - pct(f->largest_free, f->free_bytes) : 0.0);
+
+    if (f->free_blocks == 0) {
+        printf("\n");
+        return;
+    }
+    printf("\n  free blocks by size   blocks        bytes\n");
+    for (c = 0; c < NUM_CLASSES; c++) {
+        if (f->class_blocks[c] == 0)
+            continue;
+        printf("  %9llu-%-9llu %8llu %12llu\n", 1ULL << c,
+               (2ULL << c) - 1, (unsigned long long) f->class_blocks[c],
+               (unsigned long long) f->class_bytes[c]);
+    }
+    printf("\n  free blocks by list   blocks        bytes\n");
+    for (b = 0; b < h->hdr.nbins; b++) {
+        if (h->hdr.bin_limit[b])
+            printf("  %2d: <= %-11llu %8llu %12llu\n", b,
+                   (unsigned long long) h->hdr.bin_limit[b],
+                   (unsigned long long) f->bin_blocks[b],
+                   (unsigned long long) f->bin_bytes[b]);
+        else
+            printf("  %2d: rest %11s %8llu %12llu\n", b, "",
+                   (unsigned long long) f->bin_blocks[b],
+                   (unsigned long long) f->bin_bytes[b]);
+    }
+    printf("\n");
+}
+
+static const char *block_fill(const mm_heap_block_t *b, uint64_t i)
+{
+    if (b->alloc)
+        return alloc_fill[i & 1];
+    if (b->bin < 0)
+        return free_fill[0];
+    return free_fill[b->bin < NUM_FREE_FILLS ? b->bin : NUM_FREE_FILLS - 1];
+}
+
+/*
+ * write_svg - Lay the heap out in rows of width pixels, each pixel
+ *     standing for bpp bytes; blocks that cross a row end wrap
+ */
+static void write_svg(const char *path, const char *name, const heapmap_t *h,
+                      const frag_t *f, int width, uint64_t bpp)
+{
+    uint64_t row_bytes = (uint64_t) width * bpp;
+    uint64_t rows = (h->hdr.heap_bytes + row_bytes - 1) / row_bytes;
+    int height = TOP + (int) rows * (ROW_HEIGHT + ROW_GAP) + 40;
+    FILE *fp = fopen(path, "w");
+    uint64_t i;
+    int b;
+
+    if (fp == NULL)
+        fatal("could not create ", path);
+    fprintf(fp, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" "
+            "height=\"%d\" font-family=\"monospace\" font-size=\"12\">\n",
+            width + 20, height);
+    fprintf(fp, "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n");
+    fprintf(fp, "<text x=\"10\" y=\"16\">%s: %llu bytes, %llu bytes/pixel"
+            "</text>\n", name, (unsigned long long) h->hdr.heap_bytes,
+            (unsigned long long) bpp);
+    fprintf(fp, "<text x=\"10\" y=\"32\">allocated %.1f%%, free %.1f%% "
+            "(stranded %.1f%%), largest free %llu, external fragmentation "
+            "%.1f%%</text>\n", pct(f->alloc_bytes, h->hdr.heap_bytes),
+            pct(f->free_bytes, h->hdr.heap_bytes),
+            pct(f->stranded_bytes, h->hdr.heap_bytes),
+            (unsigned long long) f->largest_free,
+            f->free_bytes ? 100.0 - pct(f->largest_free, f->free_bytes) : 0.0);
+
+    for (i = 0; i < h->hdr.nblocks; i++) {
+        const mm_heap_block_t *blk = &h->blocks[i];
+        uint64_t off = blk->offset, left = blk->size;
+
+        while (left > 0) {
+            uint64_t row = off / row_bytes, col = off % row_bytes;
+            uint64_t len = row_bytes - col < left ? row_bytes - col : left;
+
+            fprintf(fp, "<rect x=\"%.2f\" y=\"%llu\" width=\"%.2f\" "
+                    "height=\"%d\" fill=\"%s\"><title>%s %llu bytes at %llu",
+                    10 + (double) col / bpp,
+                    (unsigned long long) (TOP + row * (ROW_HEIGHT + ROW_GAP)),
+                    (double) len / bpp, ROW_HEIGHT, block_fill(blk, i),
+                    blk->alloc ? "allocated" : "free",
+                    (unsigned long long) blk->size,
+                    (unsigned long long) blk->offset);
+            if (!blk->alloc)
+                fprintf(fp, ", list %d", blk->bin);
+            fprintf(fp, "</title></rect>\n");
+            off += len;
+            left -= len;
+        }
+    }
+
+    /* Legend: allocated, then each free list */
+    fprintf(fp, "<rect x=\"10\" y=\"%d\" width=\"12\" height=\"12\" "
+            "fill=\"%s\"/><text x=\"26\" y=\"%d\">allocated</text>\n",
+            height - 28, alloc_fill[0], height - 18);
+    for (b = 0; b < h->hdr.nbins && b < NUM_FREE_FILLS; b++) {
+        int x = 110 + b * 90;
+        fprintf(fp, "<rect x=\"%d\" y=\"%d\" width=\"12\" height=\"12\" "
+                "fill=\"%s\"/><text x=\"%d\" y=\"%d\">free %s%d</text>\n",
+                x, height - 28, free_fill[b], x + 16, height - 18,
+                b == NUM_FREE_FILLS - 1 && h->hdr.nbins > NUM_FREE_FILLS ?
+                ">=" : "", b);
+    }
+    fprintf(fp, "</svg>\n");
+    if (fclose(fp) != 0)
+        fatal("could not write ", path);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-s <svg>] [-w <pixels>] [-b <bytes/pixel>] "
+            "<heapmap>\n", prog);
+    fprintf(stderr, "\t-s <svg>   Draw the heap map to <svg>\n");
+    fprintf(stderr, "\t-w <px>    Map width in pixels (default %d)\n",
+            DEFAULT_WIDTH);
+    fprintf(stderr, "\t-b <n>     Bytes per pixel (default: fit the heap in "
+            "%d rows)\n", MAX_ROWS);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *svg = NULL;
+    int width = DEFAULT_WIDTH, c;
+    uint64_t bpp = 0;
+    heapmap_t h;
+    frag_t f;
+
+    while ((c = getopt(argc, argv, "s:w:b:h")) != EOF) {
+        switch (c) {
+        case 's':
+            svg = optarg;
+            break;
+        case 'w':
+            width = atoi(optarg);
+            break;
+        case 'b':
+            bpp = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || width <= 0)
+        usage(argv[0]);
+
+    read_heapmap(argv[optind], &h);
+    measure(&h, &f);
+    report(argv[optind], &h, &f);
+    if (svg) {
+        /* Smallest power of two that fits the heap in MAX_ROWS rows */
+        if (bpp == 0)
+            for (bpp = 1; h.hdr.heap_bytes > bpp * width * MAX_ROWS; bpp *= 2)
+                ;
+        write_svg(svg, argv[optind], &h, &f, width, bpp);
+    }
+    free(h.blocks);
+    return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * mmops.c - Allocator vtable used by the driver
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "mmops.h"
+#include "memlib.h"
+#include "config.h"
+
+const mm_ops_t mm_builtin_ops = {
+    "mm.c",
+    mm_init,
+    mm_malloc,
+    mm_free,
+    mm_realloc,
+    mm_calloc,
+    mm_checkheap,
+    mem_heap_lo,
+    mem_heap_hi,
+    mm_freeinfo,
+    mm_stats,
+    mm_prof_dump,
+    mm_trace_dump,
+    mm_cycles,
+    mm_heap_dump
+};
+
+/*
+ * The null allocator: hands out consecutive addresses from an arena
+ * that nobody touches, wrapping around when it runs out, and ignores
+ * free.  Timing it measures only the driver's own per-op overhead.
+ */
+#define NULL_ARENA_BYTES (64 << 20)
+
+static char null_arena[NULL_ARENA_BYTES];
+static size_t null_brk;
+
+static bool null_init(void)
+{
+    null_brk = 0;
+    return true;
+}
+
+static void *null_malloc(size_t size)
+{
+    void *p;
+
+    size = (size + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1);
+    if (size > NULL_ARENA_BYTES)
+        return NULL;
+    if (null_brk + size > NULL_ARENA_BYTES)
+        null_brk = 0;
+    p = null_arena + null_brk;
+    null_brk += size;
+    return p;
+}
+
+static void null_free(void *ptr)
+{
+    (void) ptr;
+}
+
+static void *null_realloc(void *ptr, size_t size)
+{
+    (void) ptr;
+    return size == 0 ? NULL : null_malloc(size);
+}
+
+static void *null_calloc(size_t nmemb, size_t size)
+{
+    return null_malloc(nmemb * size);
+}
+
+static bool null_checkheap(int lineno)
+{
+    (void) lineno;
+    return true;
+}
+
+static void *null_heap_lo(void)
+{
+    return null_arena;
+}
+
+static void *null_heap_hi(void)
+{
+    return null_arena + NULL_ARENA_BYTES - 1;
+}
+
+const mm_ops_t mm_null_ops = {
+    "null",
+    null_init,
+    null_malloc,
+    null_free,
+    null_realloc,
+    null_calloc,
+    null_checkheap,
+    null_heap_lo,
+    null_heap_hi,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+/* Look up a symbol that the allocator must provide */
+static void *need(void *handle, const char *sym, const char *path,
+                  char *err, size_t errlen)
+{
+    void *p = dlsym(handle, sym);
+    if (p == NULL)
+        snprintf(err, errlen, "%s does not define %s", path, sym);
+    return p;
+}
+
+mm_ops_t *mm_ops_load(const char *path, char *err, size_t errlen)
+{
+    void *handle;
+    mm_ops_t *ops;
+    const char *base;
+    char *dot;
+
+    /* RTLD_LOCAL keeps its mm_* symbols from clashing with the driver's */
+    if ((handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+        snprintf(err, errlen, "%s", dlerror());
+        return NULL;
+    }
+    if ((ops = calloc(1, sizeof(mm_ops_t))) == NULL) {
+        snprintf(err, errlen, "out of memory");
+        dlclose(handle);
+        return NULL;
+    }
+
+    base = strrchr(path, '/');
+    snprintf(ops->name, sizeof(ops->name), "%s", base ? base + 1 : path);
+    if ((dot = strrchr(ops->name, '.')) != NULL)
+        *dot = '\0';
+
+    *(void **) &ops->init = need(handle, "mm_init", path, err, errlen);
+    *(void **) &ops->malloc = need(handle, "mm_malloc", path, err, errlen);
+    *(void **) &ops->free = need(handle, "mm_free", path, err, errlen);
+    *(void **) &ops->realloc = need(handle, "mm_realloc", path, err, errlen);
+    *(void **) &ops->calloc = need(handle, "mm_calloc", path, err, errlen);
+    *(void **) &ops->checkheap = need(handle, "mm_checkheap", path, err, errlen);
+    if (!ops->init || !ops->malloc || !ops->free || !ops->realloc ||
+        !ops->calloc || !ops->checkheap) {
+        free(ops);
+        dlclose(handle);
+        return NULL;
+    }
+
+    /* Optional entry points */
+    *(void **) &ops->freeinfo = dlsym(handle, "mm_freeinfo");
+    *(void **) &ops->stats = dlsym(handle, "mm_stats");
+    *(void **) &ops->prof_dump = dlsym(handle, "mm_prof_dump");
+    *(void **) &ops->trace_dump = dlsym(handle, "mm_trace_dump");
+    *(void **) &ops->cycles = dlsym(handle, "mm_cycles");
+    *(void **) &ops->heap_dump = dlsym(handle, "mm_heap_dump");
+    *(void **) &ops->heap_lo = dlsym(handle, "mm_heap_lo");
+    *(void **) &ops->heap_hi = dlsym(handle, "mm_heap_hi");
+    if (!ops->heap_lo || !ops->heap_hi) {
+        ops->heap_lo = mem_heap_lo;
+        ops->heap_hi = mem_heap_hi;
+    }
+    return ops;
+}
@@ -0,0 +1,52 @@
+#ifndef __MMOPS_H_
+#define __MMOPS_H_
+
+/*
+ * mmops.h - Allocator vtable used by the driver
+ *
+ * The driver calls the allocator under test only through an mm_ops_t,
+ * so the mm.c linked into mdriver and allocators loaded from shared
+ * objects (-a) run through exactly the same code paths.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "mm.h"
+
+typedef struct {
+    char name[64];                           /* label used in the reports */
+    bool (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void *(*calloc)(size_t nmemb, size_t size);
+    bool (*checkheap)(int lineno);
+    void *(*heap_lo)(void);                  /* first heap byte */
+    void *(*heap_hi)(void);                  /* last heap byte */
+    void (*freeinfo)(mm_freeinfo_t *info);   /* optional, may be NULL */
+    void (*stats)(mm_stats_t *stats);        /* optional, may be NULL */
+    int (*prof_dump)(int fd);                /* optional, may be NULL */
+    int (*trace_dump)(int fd);               /* optional, may be NULL */
+    int (*cycles)(mm_cycles_t *cycles);      /* optional, may be NULL */
+    int (*heap_dump)(int fd);                /* optional, may be NULL */
+} mm_ops_t;
+
+/* The mm.c package linked into the driver */
+extern const mm_ops_t mm_builtin_ops;
+
+/* A bump allocator that never reuses or touches memory, for measuring
+   the driver's overhead.  Its blocks must not be written to */
+extern const mm_ops_t mm_null_ops;
+
+/*
+ * Load an allocator from the shared object at path.  The object must
+ * export mm_init, mm_malloc, mm_free, mm_realloc, mm_calloc and
+ * mm_checkheap, and may export mm_freeinfo, mm_stats, mm_prof_dump,
+ * mm_trace_dump, mm_cycles and mm_heap_dump.  It gets its heap from
+ * the driver's memlib (mem_sbrk), unless it also exports mm_heap_lo
+ * and mm_heap_hi.  Returns NULL and fills err on failure.
+ */
+mm_ops_t *mm_ops_load(const char *path, char *err, size_t errlen);
+
+#endif /* __MMOPS_H_ */
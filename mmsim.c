@@ -0,0 +1,669 @@
+/*
+ * mmsim.c - Replay traces against metadata-only models of mm.c's policies
+ *
+ * Trying a placement policy in mm.c means editing it and running the
+ * driver, which writes and checks every payload.  mmsim instead keeps
+ * only block sizes, addresses and free lists, so one trace can be run
+ * against many policies in the time the driver takes for one.  Each
+ * configuration is a comma-separated list of settings, any of which
+ * may be left out to keep mm.c's:
+ *
+ *   bins=16:32:64:128:256:512   upper block-size limits of the free
+ *                               lists; one more list takes the rest
+ *   fit=nfit                    first, next, best, or nfit: the best of
+ *                               the first n blocks that fit, stopping
+ *                               early at an exact fit
+ *   n=70                        blocks nfit looks at
+ *   order=lifo                  where freed blocks go in their list:
+ *                               lifo, fifo, or addr (address order)
+ *   split=16                    smallest remainder worth splitting off
+ *   chunk=4096                  least the heap grows by
+ *
+ * The model follows mm.c: blocks are the request plus an 8-byte header
+ * rounded up to 16, at least 16; frees coalesce at once; realloc is
+ * malloc, copy and free; and the heap grows by max(request, chunk)
+ * without reusing a free block at its end.  With the defaults it gives
+ * the same heap size as mm.c on every trace.
+ *
+ * For every configuration and trace it reports utilization (peak
+ * payload over heap size), how many free blocks each malloc examined,
+ * and how often the heap had to grow.  Results go to stdout as a table
+ * or, with -o, to a CSV file with one row per configuration and trace,
+ * for sweeps over many configurations (-C reads them from a file, one
+ * per line).
+ *
+ * Usage: mmsim [-c <config>]... [-C <file>] [-o <out.csv>] <trace>...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tracefile.h"
+
+#define MAX_BINS 32
+#define MAX_CONFIGS 65536
+#define CONFIG_LEN 256
+#define NONE (-1L)
+#define MAX_PROBE_COUNT 1024 /* probe counts kept exactly up to this */
+
+/* Block layout, as in mm.c */
+#define HEADER_BYTES 8
+#define ALIGN_BYTES 16
+#define MIN_BLOCK 16
+#define HEAP_START 16         /* prologue footer and epilogue header */
+
+typedef enum { FIT_FIRST, FIT_NEXT, FIT_BEST, FIT_NFIT } fit_t;
+typedef enum { ORDER_LIFO, ORDER_FIFO, ORDER_ADDR } order_t;
+
+static const char *fit_names[] = { "first", "next", "best", "nfit" };
+static const char *order_names[] = { "lifo", "fifo", "addr" };
+
+typedef struct {
+    char text[CONFIG_LEN];     /* as given, for the report */
+    int nbins;                 /* the last bin has no upper limit */
+    size_t bin_limit[MAX_BINS];
+    fit_t fit;
+    long n;
+    order_t order;
+    size_t split;
+    size_t chunk;
+} config_t;
+
+/* One block of the modelled heap */
+typedef struct {
+    size_t addr, size;
+    int free;
+    long prev, next;           /* neighbours in address order */
+    long fprev, fnext;         /* neighbours in its free list */
+} sblock_t;
+
+typedef struct {
+    const config_t *cf;
+    sblock_t *blocks;
+    long nblocks, capacity;
+    long spare;                /* unused block records, linked by next */
+    long last;                 /* highest-addressed block */
+    long head[MAX_BINS], tail[MAX_BINS], rover[MAX_BINS];
+    size_t heap;
+
+    /* results */
+    long mallocs, extends, splits, coalesces;
+    double probes;             /* free blocks examined by all mallocs */
+    long max_probes;
+    long probe_count[MAX_PROBE_COUNT + 1]; /* mallocs by probes, the last
+                                              counting all beyond */
+} sim_t;
+
+/*
+ * Configurations
+ */
+
+static void default_config(config_t *cf)
+{
+    static const size_t limits[] = { 16, 32, 64, 128, 256, 512 };
+    size_t i;
+
+    memset(cf, 0, sizeof(*cf));
+    for (i = 0; i < sizeof(limits) / sizeof(limits[0]); i++)
+        cf->bin_limit[i] = limits[i];
+    cf->nbins = (int) i + 1;
+    cf->fit = FIT_NFIT;
+    cf->n = 70;
+    cf->order = ORDER_LIFO;
+    cf->split = MIN_BLOCK;
+    cf->chunk = 1 << 12;
+}
+
+static int lookup(const char *value, const char **names, int count)
+{
+    int i;
+    for (i = 0; i < count; i++)
+        if (strcmp(value, names[i]) == 0)
+            return i;
+    return -1;
+}
+
+/* Parse a configuration.  Returns 0, or -1 with a message in err */
+static int parse_config(const char *text, config_t *cf, char *err, size_t errlen)
+{
+    char buf[CONFIG_LEN], *item, *save = NULL;
+
+    default_config(cf);
+    if (strlen(text) >= CONFIG_LEN) {
+        snprintf(err, errlen, "configuration too long");
+        return -1;
+    }
+    strcpy(cf->text, text[0] ? text : "mm.c");
+    strcpy(buf, text);
+    for (item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(item, '=');
+        if (value == NULL) {
+            snprintf(err, errlen, "expected key=value, not %s", item);
+            return -1;
+        }
+        *value++ = '\0';
+        if (strcmp(item, "bins") == 0) {
+            char *lim, *lsave = NULL;
+            cf->nbins = 0;
+            for (lim = strtok_r(value, ":", &lsave); lim;
+                 lim = strtok_r(NULL, ":", &lsave)) {
+                if (cf->nbins == MAX_BINS - 1) {
+                    snprintf(err, errlen, "at most %d bin limits", MAX_BINS - 1);
+                    return -1;
+                }
+                cf->bin_limit[cf->nbins] = strtoul(lim, NULL, 0);
+                if (cf->nbins > 0 &&
+                    cf->bin_limit[cf->nbins] <= cf->bin_limit[cf->nbins - 1]) {
+                    snprintf(err, errlen, "bin limits must increase");
+                    return -1;
+                }
+                cf->nbins++;
+            }
+            cf->nbins++;
+        } else if (strcmp(item, "fit") == 0) {
+            int fit = lookup(value, fit_names, 4);
+            if (fit < 0) {
+                snprintf(err, errlen, "unknown fit %s", value);
+                return -1;
+            }
+            cf->fit = (fit_t) fit;
+        } else if (strcmp(item, "n") == 0) {
+            cf->n = atol(value);
+        } else if (strcmp(item, "order") == 0) {
+            int order = lookup(value, order_names, 3);
+            if (order < 0) {
+                snprintf(err, errlen, "unknown order %s", value);
+                return -1;
+            }
+            cf->order = (order_t) order;
+        } else if (strcmp(item, "split") == 0) {
+            cf->split = strtoul(value, NULL, 0);
+        } else if (strcmp(item, "chunk") == 0) {
+            cf->chunk = strtoul(value, NULL, 0);
+        } else {
+            snprintf(err, errlen, "unknown setting %s", item);
+            return -1;
+        }
+    }
+    if (cf->n < 1 || cf->split < MIN_BLOCK || cf->chunk < MIN_BLOCK) {
+        snprintf(err, errlen, "n must be at least 1, split and chunk at least %d",
+                 MIN_BLOCK);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * The model
+ */
+
+static size_t round_up(size_t size, size_t n)
+{
+    return n * ((size + (n - 1)) / n);
+}
+
+static int size_to_bin(const config_t *cf, size_t size)
+{
+    int i;
+    for (i = 0; i < cf->nbins - 1; i++)
+        if (size <= cf->bin_limit[i])
+            return i;
+    return cf->nbins - 1;
+}
+
+static long new_block(sim_t *sim, size_t addr, size_t size)
+{
+    long b;
+
+    if (sim->spare != NONE) {
+        b = sim->spare;
+        sim->spare = sim->blocks[b].next;
+    } else {
+        if (sim->nblocks == sim->capacity) {
+            sim->capacity = sim->capacity ? 2 * sim->capacity : 1024;
+            sim->blocks = realloc(sim->blocks, sim->capacity * sizeof(sblock_t));
+            if (sim->blocks == NULL) {
+                fprintf(stderr, "Fatal error.  Out of memory in simulation\n");
+                exit(1);
+            }
+        }
+        b = sim->nblocks++;
+    }
+    sim->blocks[b].addr = addr;
+    sim->blocks[b].size = size;
+    sim->blocks[b].free = 0;
+    sim->blocks[b].prev = sim->blocks[b].next = NONE;
+    sim->blocks[b].fprev = sim->blocks[b].fnext = NONE;
+    return b;
+}
+
+static void drop_block(sim_t *sim, long b)
+{
+    sim->blocks[b].next = sim->spare;
+    sim->spare = b;
+}
+
+static void list_remove(sim_t *sim, long b)
+{
+    sblock_t *blk = &sim->blocks[b];
+    int bin = size_to_bin(sim->cf, blk->size);
+
+    if (sim->rover[bin] == b)
+        sim->rover[bin] = blk->fnext;
+    if (blk->fprev != NONE)
+        sim->blocks[blk->fprev].fnext = blk->fnext;
+    else
+        sim->head[bin] = blk->fnext;
+    if (blk->fnext != NONE)
+        sim->blocks[blk->fnext].fprev = blk->fprev;
+    else
+        sim->tail[bin] = blk->fprev;
+    blk->free = 0;
+}
+
+static void list_insert(sim_t *sim, long b)
+{
+    sblock_t *blk = &sim->blocks[b];
+    int bin = size_to_bin(sim->cf, blk->size);
+    long after = NONE;         /* insert after this block, or at the head */
+
+    if (sim->cf->order == ORDER_FIFO) {
+        after = sim->tail[bin];
+    } else if (sim->cf->order == ORDER_ADDR) {
+        long p;
+        for (p = sim->head[bin]; p != NONE && sim->blocks[p].addr < blk->addr;
+             p = sim->blocks[p].fnext)
+            after = p;
+    }
+    blk->fprev = after;
+    blk->fnext = after == NONE ? sim->head[bin] : sim->blocks[after].fnext;
+    if (blk->fprev != NONE)
+        sim->blocks[blk->fprev].fnext = b;
+    else
+        sim->head[bin] = b;
+    if (blk->fnext != NONE)
+        sim->blocks[blk->fnext].fprev = b;
+    else
+        sim->tail[bin] = b;
+    blk->free = 1;
+}
+
+/* Free block b, coalescing it with free neighbours */
+static void coalesce(sim_t *sim, long b)
+{
+    sblock_t *blk = &sim->blocks[b];
+    long next = blk->next, prev = blk->prev;
+
+    if (next != NONE && sim->blocks[next].free) {
+        list_remove(sim, next);
+        blk->size += sim->blocks[next].size;
+        blk->next = sim->blocks[next].next;
+        if (blk->next != NONE)
+            sim->blocks[blk->next].prev = b;
+        else
+            sim->last = b;
+        drop_block(sim, next);
+        sim->coalesces++;
+    }
+    if (prev != NONE && sim->blocks[prev].free) {
+        sblock_t *pblk = &sim->blocks[prev];
+        list_remove(sim, prev);
+        pblk->size += blk->size;
+        pblk->next = blk->next;
+        if (pblk->next != NONE)
+            sim->blocks[pblk->next].prev = prev;
+        else
+            sim->last = prev;
+        drop_block(sim, b);
+        sim->coalesces++;
+        b = prev;
+    }
+    list_insert(sim, b);
+}
+
+static long extend_heap(sim_t *sim, size_t size)
+{
+    long b;
+
+    size = round_up(size, ALIGN_BYTES);
+    b = new_block(sim, sim->heap, size);
+    sim->blocks[b].prev = sim->last;
+    if (sim->last != NONE)
+        sim->blocks[sim->last].next = b;
+    sim->last = b;
+    sim->heap += size;
+    sim->extends++;
+    coalesce(sim, b);
+    /* The new space is either b or the free block before it */
+    return sim->blocks[sim->last].free ? sim->last : NONE;
+}
+
+/* Search one list from start to stop (exclusive), as the fit says */
+static long search(sim_t *sim, long start, long stop, size_t asize,
+                   long *left, long *probes, long *best)
+{
+    long p;
+
+    for (p = start; p != stop && p != NONE && *left > 0; p = sim->blocks[p].fnext) {
+        size_t size = sim->blocks[p].size;
+        (*probes)++;
+        if (size < asize)
+            continue;
+        (*left)--;
+        if (size == asize)
+            return p;
+        if (*best == NONE || size < sim->blocks[*best].size)
+            *best = p;
+    }
+    return NONE;
+}
+
+static long find_fit(sim_t *sim, size_t asize, long *probes)
+{
+    const config_t *cf = sim->cf;
+    long best = NONE, found, left;
+    int bin;
+
+    switch (cf->fit) {
+    case FIT_FIRST: left = 1; break;
+    case FIT_NEXT:  left = 1; break;
+    case FIT_BEST:  left = sim->nblocks + 1; break;
+    default:        left = cf->n; break;
+    }
+    for (bin = size_to_bin(cf, asize); bin < cf->nbins && left > 0; bin++) {
+        if (cf->fit == FIT_NEXT && sim->rover[bin] != NONE) {
+            /* From the rover to the end of the list, then round to it */
+            long rover = sim->rover[bin];
+            found = search(sim, rover, NONE, asize, &left, probes, &best);
+            if (found == NONE && best == NONE)
+                found = search(sim, sim->head[bin], rover, asize, &left,
+                               probes, &best);
+        } else {
+            found = search(sim, sim->head[bin], NONE, asize, &left, probes, &best);
+        }
+        if (found != NONE)
+            return found;
+    }
+    return best;
+}
+
+static void place(sim_t *sim, long b, size_t asize)
+{
+    sblock_t *blk = &sim->blocks[b];
+    int bin = size_to_bin(sim->cf, blk->size);
+
+    if (sim->cf->fit == FIT_NEXT)
+        sim->rover[bin] = blk->fnext;
+    list_remove(sim, b);
+    blk = &sim->blocks[b];
+    if (blk->size - asize >= sim->cf->split) {
+        long r = new_block(sim, blk->addr + asize, blk->size - asize);
+        blk = &sim->blocks[b];     /* new_block may move the array */
+        blk->size = asize;
+        sim->blocks[r].prev = b;
+        sim->blocks[r].next = blk->next;
+        if (blk->next != NONE)
+            sim->blocks[blk->next].prev = r;
+        else
+            sim->last = r;
+        blk->next = r;
+        list_insert(sim, r);
+        sim->splits++;
+    }
+}
+
+static long sim_malloc(sim_t *sim, size_t size)
+{
+    size_t asize;
+    long b, probes = 0;
+
+    if (size == 0)
+        return NONE;
+    asize = round_up(size + HEADER_BYTES, ALIGN_BYTES);
+    if (asize < MIN_BLOCK)
+        asize = MIN_BLOCK;
+
+    b = find_fit(sim, asize, &probes);
+    if (b == NONE)
+        b = extend_heap(sim, asize > sim->cf->chunk ? asize : sim->cf->chunk);
+    place(sim, b, asize);
+
+    sim->mallocs++;
+    sim->probes += probes;
+    if (probes > sim->max_probes)
+        sim->max_probes = probes;
+    sim->probe_count[probes < MAX_PROBE_COUNT ? probes : MAX_PROBE_COUNT]++;
+    return b;
+}
+
+static void sim_free(sim_t *sim, long b)
+{
+    if (b != NONE)
+        coalesce(sim, b);
+}
+
+/*
+ * Run one trace under one configuration
+ */
+static void simulate(const config_t *cf, const tf_trace_t *trace, sim_t *sim,
+                     long *ids, double *util)
+{
+    size_t live = 0, peak = 0;
+    size_t *sizes = calloc(trace->num_ids + 1, sizeof(size_t));
+    int i;
+
+    if (sizes == NULL) {
+        fprintf(stderr, "Fatal error.  Out of memory in simulation\n");
+        exit(1);
+    }
+    sim->cf = cf;
+    sim->nblocks = 0;
+    sim->spare = sim->last = NONE;
+    for (i = 0; i < MAX_BINS; i++)
+        sim->head[i] = sim->tail[i] = sim->rover[i] = NONE;
+    sim->heap = HEAP_START;
+    sim->mallocs = sim->extends = sim->splits = sim->coalesces = 0;
+    sim->probes = 0;
+    sim->max_probes = 0;
+    memset(sim->probe_count, 0, sizeof(sim->probe_count));
+    extend_heap(sim, cf->chunk);
+
+    for (i = 0; i < trace->num_ids; i++)
+        ids[i] = NONE;
+    for (i = 0; i < trace->num_ops; i++) {
+        const tf_op_t *op = &trace->ops[i];
+        long id = op->index, b;
+
+        switch (op->type) {
+        case TF_ALLOC:
+            ids[id] = sim_malloc(sim, op->size);
+            live += op->size;
+            sizes[id] = op->size;
+            break;
+        case TF_REALLOC:
+            if (op->size == 0) {
+                sim_free(sim, ids[id]);
+                b = NONE;
+            } else {
+                b = sim_malloc(sim, op->size);
+                sim_free(sim, ids[id]);
+            }
+            ids[id] = b;
+            live += op->size - sizes[id];
+            sizes[id] = op->size;
+            break;
+        case TF_FREE:
+            if (id >= 0) {
+                sim_free(sim, ids[id]);
+                ids[id] = NONE;
+                live -= sizes[id];
+                sizes[id] = 0;
+            }
+            break;
+        }
+        if (live > peak)
+            peak = live;
+    }
+    *util = (double) peak / (double) sim->heap;
+    free(sizes);
+}
+
+/* The probe count that the given fraction of mallocs stayed within */
+static long probe_percentile(const sim_t *sim, double frac)
+{
+    long seen = 0, k;
+
+    for (k = 0; k < MAX_PROBE_COUNT; k++) {
+        seen += sim->probe_count[k];
+        if (seen >= frac * sim->mallocs)
+            return k;
+    }
+    return sim->max_probes;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-c <config>]... [-C <file>] [-o <out.csv>] "
+            "<trace>...\n", prog);
+    fprintf(stderr, "\t-c <config>  Simulate a configuration, e.g. "
+            "fit=best,order=addr\n");
+    fprintf(stderr, "\t             (default: mm.c's; repeatable)\n");
+    fprintf(stderr, "\t-C <file>    Read configurations from <file>, one per line\n");
+    fprintf(stderr, "\t-o <file>    Write results as CSV to <file>\n");
+    exit(1);
+}
+
+static void add_config(config_t **configs, int *nconfigs, const char *text)
+{
+    char err[128];
+
+    if (*nconfigs == MAX_CONFIGS) {
+        fprintf(stderr, "mmsim: at most %d configurations\n", MAX_CONFIGS);
+        exit(1);
+    }
+    if (*nconfigs % 64 == 0) {
+        *configs = realloc(*configs, (*nconfigs + 64) * sizeof(config_t));
+        if (*configs == NULL) {
+            fprintf(stderr, "Fatal error.  Out of memory reading configurations\n");
+            exit(1);
+        }
+    }
+    if (parse_config(text, &(*configs)[*nconfigs], err, sizeof(err)) < 0) {
+        fprintf(stderr, "mmsim: bad configuration \"%s\": %s\n", text, err);
+        exit(1);
+    }
+    (*nconfigs)++;
+}
+
+static void read_configs(config_t **configs, int *nconfigs, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[CONFIG_LEN + 2];
+
+    if (fp == NULL) {
+        fprintf(stderr, "mmsim: could not open %s\n", path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n#")] = '\0';
+        if (line[strspn(line, " \t")] != '\0')
+            add_config(configs, nconfigs, line);
+    }
+    fclose(fp);
+}
+
+int main(int argc, char **argv)
+{
+    config_t *configs = NULL;
+    tf_trace_t **traces;
+    int nconfigs = 0, ntraces, c, i, j;
+    const char *csv_path = NULL;
+    FILE *csv = NULL;
+    sim_t sim;
+    char err[256];
+
+    while ((c = getopt(argc, argv, "c:C:o:h")) != EOF) {
+        switch (c) {
+        case 'c':
+            add_config(&configs, &nconfigs, optarg);
+            break;
+        case 'C':
+            read_configs(&configs, &nconfigs, optarg);
+            break;
+        case 'o':
+            csv_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+    if (nconfigs == 0)
+        add_config(&configs, &nconfigs, "");
+
+    /* Load every trace once, for all the configurations */
+    ntraces = argc - optind;
+    traces = calloc(ntraces, sizeof(tf_trace_t *));
+    for (i = 0; i < ntraces; i++) {
+        if ((traces[i] = tf_read(argv[optind + i], err, sizeof(err))) == NULL) {
+            fprintf(stderr, "%s: %s\n", argv[0], err);
+            exit(1);
+        }
+    }
+    if (csv_path) {
+        if ((csv = fopen(csv_path, "w")) == NULL) {
+            fprintf(stderr, "%s: could not create %s\n", argv[0], csv_path);
+            exit(1);
+        }
+        fprintf(csv, "config,trace,util,heap,mallocs,probes_mean,probes_p99,"
+                "probes_max,extends,splits,coalesces\n");
+    }
+
+    memset(&sim, 0, sizeof(sim));
+    for (j = 0; j < nconfigs; j++) {
+        double sum_util = 0;
+
+        if (!csv)
+            printf("%s\n%7s%10s%8s%8s%8s%9s  %s\n", configs[j].text, "util",
+                   "heap", "probes", "p99", "max", "extends", "trace");
+        for (i = 0; i < ntraces; i++) {
+            const tf_trace_t *trace = traces[i];
+            long *ids = malloc((trace->num_ids + 1) * sizeof(long));
+            double util, mean;
+
+            if (ids == NULL) {
+                fprintf(stderr, "Fatal error.  Out of memory in simulation\n");
+                exit(1);
+            }
+            simulate(&configs[j], trace, &sim, ids, &util);
+            free(ids);
+            mean = sim.mallocs ? sim.probes / sim.mallocs : 0.0;
+            sum_util += util;
+            if (csv) {
+                fprintf(csv, "\"%s\",\"%s\",%.6f,%zu,%ld,%.3f,%ld,%ld,%ld,%ld,%ld\n",
+                        configs[j].text, argv[optind + i], util, sim.heap,
+                        sim.mallocs, mean, probe_percentile(&sim, 0.99),
+                        sim.max_probes, sim.extends, sim.splits, sim.coalesces);
+            } else {
+                printf("%6.1f%%%10zu%8.1f%8ld%8ld%9ld  %s\n", 100.0 * util,
+                       sim.heap, mean, probe_percentile(&sim, 0.99),
+                       sim.max_probes, sim.extends, argv[optind + i]);
+            }
+        }
+        if (!csv)
+            printf("%6.1f%% average utilization\n\n", 100.0 * sum_util / ntraces);
+    }
+
+    if (csv && fclose(csv) != 0) {
+        fprintf(stderr, "%s: error writing %s\n", argv[0], csv_path);
+        exit(1);
+    }
+    for (i = 0; i < ntraces; i++)
+        tf_free(traces[i]);
+    free(traces);
+    free(configs);
+    free(sim.blocks);
+    return 0;
+}
@@ -0,0 +1,415 @@
+/*
+ * mmtune.c - Search mm.c's build-time parameters for the best on a trace set
+ *
+ * mm.c takes CHUNKSIZE, N_SIZE and its segregated list limits
+ * (SLIST_LIMITS) from the build, defaulting to the values it was
+ * written with.  mmtune builds a driver for each candidate setting
+ * ("make <dir>/c<k>.mdriver" from a generated c<k>.h), runs them in
+ * parallel over the chosen traces with --json, and writes the best
+ * candidate's settings as a header, to build the real thing with
+ *
+ *     make clean && make MMCONF=mm_tuned.h
+ *
+ * Candidates are drawn at random from a grid, or with -g the whole
+ * grid is tried; the first candidate is always mm.c's defaults, so the
+ * result is never worse than what it started from on these traces.
+ * The grid covers chunk sizes from 1K to 64K, N_SIZE from 1 to 1000,
+ * and list limits growing geometrically from 16 by 1.5x to 4x.
+ *
+ * Candidates are ranked by the driver's perf index by default, and by
+ * util and then throughput where the index ties at its cap.  Runs
+ * in parallel compete for the CPUs, which makes throughput noisy: for
+ * throughput-weighted scores, use no more jobs than there are idle CPUs.
+ *
+ * Usage: mmtune [-g] [-n <candidates>] [-j <jobs>] [-s <seed>]
+ *               [-S index|util|tput] [-d <dir>] [-o <out.h>]
+ *               [-x <driver arg>]... -f <trace>...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "json.h"
+
+#define MAX_LIMITS 15          /* mm.c's lists, less the last (MM_MAX_BINS) */
+#define MAX_ARGS 256
+#define PATH_LEN 1024
+#define DEFAULT_CANDIDATES 32
+
+static const size_t chunk_grid[] = { 1024, 2048, 4096, 8192, 16384, 32768, 65536 };
+static const int nsize_grid[] = { 1, 2, 4, 8, 16, 32, 70, 128, 1000 };
+static const double factor_grid[] = { 1.5, 2, 3, 4 };
+static const int count_grid[] = { 3, 5, 7, 9, 11 };   /* limits above 16 */
+
+#define GRID_LEN(a) (int) (sizeof(a) / sizeof((a)[0]))
+
+typedef enum { SCORE_INDEX, SCORE_UTIL, SCORE_TPUT } score_t;
+
+typedef struct {
+    size_t chunk;
+    int nsize;
+    double factor;
+    int nlimits;
+    size_t limits[MAX_LIMITS];
+
+    /* results */
+    pid_t pid;
+    int done, ok;
+    double perfindex, util, tput;
+} cand_t;
+
+static const char *workdir = "tune";
+static const char *trace_args[MAX_ARGS];
+static int num_trace_args = 0;
+
+static void set_limits(cand_t *c, double factor, int count)
+{
+    size_t limit = 16;
+    int i;
+
+    c->factor = factor;
+    c->nlimits = count;
+    for (i = 0; i < count; i++) {
+        size_t next = (size_t) (limit * factor + 15) / 16 * 16;
+        limit = next > limit ? next : limit + 16;
+        c->limits[i] = limit;
+    }
+}
+
+/* The i'th point of the grid, in mixed radix */
+static void grid_point(cand_t *c, long i)
+{
+    memset(c, 0, sizeof(*c));
+    c->chunk = chunk_grid[i % GRID_LEN(chunk_grid)];
+    i /= GRID_LEN(chunk_grid);
+    c->nsize = nsize_grid[i % GRID_LEN(nsize_grid)];
+    i /= GRID_LEN(nsize_grid);
+    set_limits(c, factor_grid[i % GRID_LEN(factor_grid)],
+               count_grid[(i / GRID_LEN(factor_grid)) % GRID_LEN(count_grid)]);
+}
+
+static long grid_size(void)
+{
+    return (long) GRID_LEN(chunk_grid) * GRID_LEN(nsize_grid) *
+        GRID_LEN(factor_grid) * GRID_LEN(count_grid);
+}
+
+/* mm.c as written: 4K chunks, N_SIZE 70, limits 32..512 */
+static void default_point(cand_t *c)
+{
+    memset(c, 0, sizeof(*c));
+    c->chunk = 4096;
+    c->nsize = 70;
+    set_limits(c, 2, 5);
+}
+
+static int same_point(const cand_t *a, const cand_t *b)
+{
+    return a->chunk == b->chunk && a->nsize == b->nsize &&
+        a->nlimits == b->nlimits &&
+        memcmp(a->limits, b->limits, a->nlimits * sizeof(size_t)) == 0;
+}
+
+static void write_settings(FILE *fp, const cand_t *c)
+{
+    int i;
+
+    fprintf(fp, "#define CHUNKSIZE %zu\n", c->chunk);
+    fprintf(fp, "#define N_SIZE %d\n", c->nsize);
+    fprintf(fp, "#define SLIST_LIMITS ");
+    for (i = 0; i < c->nlimits; i++)
+        fprintf(fp, "%s%zu", i ? ", " : "", c->limits[i]);
+    fprintf(fp, "\n");
+}
+
+static void write_header(const char *path, const cand_t *c, const char *comment)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL) {
+        fprintf(stderr, "mmtune: could not create %s\n", path);
+        exit(1);
+    }
+    fprintf(fp, "/* %s */\n", comment);
+    write_settings(fp, c);
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "mmtune: error writing %s\n", path);
+        exit(1);
+    }
+}
+
+/* Run argv to completion with output going to log; returns its status */
+static int run(char **argv, int log)
+{
+    pid_t pid = fork();
+    int status;
+
+    if (pid < 0)
+        return -1;
+    if (pid == 0) {
+        dup2(log, STDOUT_FILENO);
+        dup2(log, STDERR_FILENO);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR)
+            return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* Build and run candidate k, in a child process */
+static pid_t start(int k, char **driver_args, int num_driver_args)
+{
+    char bin[PATH_LEN], json[PATH_LEN], logpath[PATH_LEN];
+    char *argv[MAX_ARGS * 2 + 8];
+    pid_t pid;
+    int i, n = 0, log;
+
+    snprintf(bin, sizeof(bin), "%s/c%d.mdriver", workdir, k);
+    snprintf(json, sizeof(json), "%s/c%d.json", workdir, k);
+    snprintf(logpath, sizeof(logpath), "%s/c%d.log", workdir, k);
+
+    if ((pid = fork()) != 0)
+        return pid;
+
+    if ((log = open(logpath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        _exit(1);
+    argv[0] = "make";
+    argv[1] = "-s";
+    argv[2] = bin;
+    argv[3] = NULL;
+    if (run(argv, log) != 0)
+        _exit(1);
+
+    argv[n++] = bin;
+    for (i = 0; i < num_trace_args; i++) {
+        argv[n++] = "-f";
+        argv[n++] = (char *) trace_args[i];
+    }
+    for (i = 0; i < num_driver_args; i++)
+        argv[n++] = driver_args[i];
+    argv[n++] = "--json";
+    argv[n++] = json;
+    argv[n] = NULL;
+    _exit(run(argv, log) == 0 ? 0 : 1);
+}
+
+static void collect(cand_t *c, int k, int status)
+{
+    char path[PATH_LEN], err[256];
+    json_value_t *root, *sum;
+
+    c->done = 1;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return;
+    snprintf(path, sizeof(path), "%s/c%d.json", workdir, k);
+    if ((root = json_parse_file(path, err, sizeof(err))) == NULL)
+        return;
+    sum = json_get(root, "summary");
+    c->ok = sum != NULL && json_number(json_get(sum, "errors"), 1) == 0;
+    c->perfindex = json_number(json_get(sum, "perfindex"), 0);
+    c->util = json_number(json_get(sum, "util"), 0);
+    c->tput = json_number(json_get(sum, "tput"), 0);
+    json_free(root);
+}
+
+static score_t score_by = SCORE_INDEX;
+
+/*
+ * better - Is a better than b?  The perf index saturates once util and
+ *     throughput pass their targets, so ties on it go to util, then
+ *     throughput.
+ */
+static int better(const cand_t *a, const cand_t *b)
+{
+    if (a->ok != b->ok)
+        return a->ok;
+    switch (score_by) {
+    case SCORE_UTIL:
+        return a->util > b->util;
+    case SCORE_TPUT:
+        return a->tput > b->tput;
+    default:
+        if (a->perfindex != b->perfindex)
+            return a->perfindex > b->perfindex;
+        if (a->util != b->util)
+            return a->util > b->util;
+        return a->tput > b->tput;
+    }
+}
+
+/* One-line summary of a candidate's settings */
+static void describe(FILE *fp, const cand_t *c)
+{
+    int i;
+
+    fprintf(fp, "chunk %zu, n %d, limits ", c->chunk, c->nsize);
+    for (i = 0; i < c->nlimits; i++)
+        fprintf(fp, "%s%zu", i ? ":" : "", c->limits[i]);
+    fprintf(fp, "\n");
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-g] [-n <candidates>] [-j <jobs>] [-s <seed>]\n"
+            "\t[-S index|util|tput] [-d <dir>] [-o <out.h>] [-x <driver arg>]...\n"
+            "\t-f <trace>...\n", prog);
+    fprintf(stderr, "\t-g            Try the whole grid (%ld points)\n", grid_size());
+    fprintf(stderr, "\t-n <n>        Try <n> random points (default %d)\n",
+            DEFAULT_CANDIDATES);
+    fprintf(stderr, "\t-j <jobs>     Run <jobs> drivers at once (default: # of CPUs)\n");
+    fprintf(stderr, "\t-s <seed>     Seed the random choice of points\n");
+    fprintf(stderr, "\t-S <score>    Rank by perf index (default), util or tput\n");
+    fprintf(stderr, "\t-d <dir>      Build and run candidates in <dir> (default tune)\n");
+    fprintf(stderr, "\t-o <file>     Write the best settings to <file> "
+            "(default mm_tuned.h)\n");
+    fprintf(stderr, "\t-x <arg>      Pass <arg> to every driver, e.g. -x -s -x 0\n");
+    fprintf(stderr, "\t-f <trace>    Tune on <trace> (repeatable)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *out = "mm_tuned.h";
+    char *driver_args[MAX_ARGS];
+    int num_driver_args = 0, grid = 0, c, k, best;
+    long ncand = DEFAULT_CANDIDATES, jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    long running = 0, next = 0;
+    unsigned seed = 1;
+    cand_t *cands;
+    char path[PATH_LEN], comment[1024];
+    char *make_argv[] = { "make", "-s", "mdriver", NULL };
+
+    while ((c = getopt(argc, argv, "gn:j:s:S:d:o:x:f:h")) != EOF) {
+        switch (c) {
+        case 'g': grid = 1; break;
+        case 'n': ncand = atol(optarg); break;
+        case 'j': jobs = atol(optarg); break;
+        case 's': seed = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'd': workdir = optarg; break;
+        case 'o': out = optarg; break;
+        case 'S':
+            if (strcmp(optarg, "util") == 0)
+                score_by = SCORE_UTIL;
+            else if (strcmp(optarg, "tput") == 0)
+                score_by = SCORE_TPUT;
+            else if (strcmp(optarg, "index") == 0)
+                score_by = SCORE_INDEX;
+            else
+                usage(argv[0]);
+            break;
+        case 'x':
+        case 'f':
+            if (num_driver_args == MAX_ARGS || num_trace_args == MAX_ARGS) {
+                fprintf(stderr, "%s: too many arguments\n", argv[0]);
+                exit(1);
+            }
+            if (c == 'x')
+                driver_args[num_driver_args++] = optarg;
+            else
+                trace_args[num_trace_args++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || num_trace_args == 0 || ncand < 1)
+        usage(argv[0]);
+    if (jobs < 1)
+        jobs = 1;
+
+    /* Pick the candidates: mm.c's defaults first */
+    if (grid)
+        ncand = grid_size() + 1;
+    cands = calloc(ncand, sizeof(cand_t));
+    default_point(&cands[0]);
+    srand(seed);
+    for (k = 1; k < ncand; k++) {
+        int tries = 0, j;
+        do {
+            grid_point(&cands[k], grid ? k - 1 : rand() % grid_size());
+            for (j = 0; j < k && !same_point(&cands[j], &cands[k]); j++)
+                ;
+        } while (j < k && !grid && ++tries < 100);
+    }
+
+    if (mkdir(workdir, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: could not create %s\n", argv[0], workdir);
+        exit(1);
+    }
+    for (k = 0; k < ncand; k++) {
+        snprintf(path, sizeof(path), "%s/c%d.h", workdir, k);
+        snprintf(comment, sizeof(comment), "mmtune candidate %d", k);
+        write_header(path, &cands[k], comment);
+    }
+
+    /* The shared driver objects, once, before candidates build in parallel */
+    if (run(make_argv, STDERR_FILENO) != 0) {
+        fprintf(stderr, "%s: could not build the driver\n", argv[0]);
+        exit(1);
+    }
+
+    printf("Trying %ld candidates, %ld at a time, in %s/\n", ncand, jobs, workdir);
+    while (next < ncand || running > 0) {
+        int status;
+        pid_t pid;
+
+        if (next < ncand && running < jobs) {
+            if ((cands[next].pid = start((int) next, driver_args,
+                                         num_driver_args)) < 0) {
+                fprintf(stderr, "%s: fork failed\n", argv[0]);
+                exit(1);
+            }
+            next++;
+            running++;
+            continue;
+        }
+        if ((pid = wait(&status)) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (k = 0; k < next; k++) {
+            if (cands[k].pid == pid && !cands[k].done) {
+                collect(&cands[k], k, status);
+                running--;
+                if (cands[k].ok)
+                    printf("%4d  index %5.1f  util %5.1f%%  %8.0f Kops/s  ",
+                           k, cands[k].perfindex, 100.0 * cands[k].util,
+                           cands[k].tput);
+                else
+                    printf("%4d  failed (see %s/c%d.log)  ", k, workdir, k);
+                describe(stdout, &cands[k]);
+                fflush(stdout);
+                break;
+            }
+        }
+    }
+
+    best = 0;
+    for (k = 1; k < ncand; k++)
+        if (better(&cands[k], &cands[best]))
+            best = k;
+    if (!cands[best].ok) {
+        fprintf(stderr, "%s: no candidate ran cleanly\n", argv[0]);
+        exit(1);
+    }
+    snprintf(comment, sizeof(comment),
+             "Generated by mmtune: perf index %.1f, util %.1f%%, %.0f Kops/s "
+             "(mm.c's defaults: %.1f, %.1f%%, %.0f Kops/s).\n"
+             "   Build with \"make clean && make MMCONF=%s\"",
+             cands[best].perfindex, 100.0 * cands[best].util, cands[best].tput,
+             cands[0].perfindex, 100.0 * cands[0].util, cands[0].tput, out);
+    write_header(out, &cands[best], comment);
+    printf("\nBest: candidate %d, written to %s\n", best, out);
+    describe(stdout, &cands[best]);
+    free(cands);
+    return 0;
+}
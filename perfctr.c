@@ -0,0 +1,135 @@
+/*
+ * perfctr.c - Hardware performance counters via perf_event_open
+ *
+ * Linux only.  Elsewhere every counter simply reports as unavailable.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perfctr.h"
+
+const char *perfctr_names[PC_NUM] = {
+    "cycles", "instrs", "L1D-miss", "LLC-miss", "dTLB-miss", "br-miss"
+};
+
+static int fds[PC_NUM] = { -1, -1, -1, -1, -1, -1 };
+
+#ifdef __linux__
+
+/* Counter layout returned by read() with the format flags used below */
+typedef struct {
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+} read_format_t;
+
+#define CACHE_MISS_CONFIG(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static int open_event(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int perfctr_open(void)
+{
+    int i, navail = 0;
+
+    perfctr_close();
+    fds[PC_CYCLES] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[PC_INSTRUCTIONS] = open_event(PERF_TYPE_HARDWARE,
+                                      PERF_COUNT_HW_INSTRUCTIONS);
+    fds[PC_L1D_MISSES] = open_event(PERF_TYPE_HW_CACHE,
+                                    CACHE_MISS_CONFIG(PERF_COUNT_HW_CACHE_L1D));
+    fds[PC_LLC_MISSES] = open_event(PERF_TYPE_HW_CACHE,
+                                    CACHE_MISS_CONFIG(PERF_COUNT_HW_CACHE_LL));
+    fds[PC_DTLB_MISSES] = open_event(PERF_TYPE_HW_CACHE,
+                                     CACHE_MISS_CONFIG(PERF_COUNT_HW_CACHE_DTLB));
+    fds[PC_BRANCH_MISSES] = open_event(PERF_TYPE_HARDWARE,
+                                       PERF_COUNT_HW_BRANCH_MISSES);
+    for (i = 0; i < PC_NUM; i++)
+        if (fds[i] >= 0)
+            navail++;
+    return navail;
+}
+
+void perfctr_start(void)
+{
+    int i;
+    for (i = 0; i < PC_NUM; i++) {
+        if (fds[i] >= 0) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void perfctr_stop(double counts[PC_NUM])
+{
+    int i;
+    read_format_t rf;
+
+    for (i = 0; i < PC_NUM; i++)
+        if (fds[i] >= 0)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    for (i = 0; i < PC_NUM; i++) {
+        counts[i] = -1.0;
+        if (fds[i] < 0 || read(fds[i], &rf, sizeof(rf)) != sizeof(rf))
+            continue;
+        if (rf.time_running == 0)
+            continue; /* never scheduled onto the PMU */
+        /* Scale up if the kernel had to multiplex the counters */
+        counts[i] = (double) rf.value *
+            ((double) rf.time_enabled / (double) rf.time_running);
+    }
+}
+
+#else /* !__linux__ */
+
+int perfctr_open(void)
+{
+    return 0;
+}
+
+void perfctr_start(void)
+{
+}
+
+void perfctr_stop(double counts[PC_NUM])
+{
+    int i;
+    for (i = 0; i < PC_NUM; i++)
+        counts[i] = -1.0;
+}
+
+#endif /* __linux__ */
+
+void perfctr_close(void)
+{
+    int i;
+    for (i = 0; i < PC_NUM; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+        fds[i] = -1;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+/*
+ * perfctr.h - Hardware performance counters via perf_event_open
+ *
+ * Counters are opened one at a time, so a machine (or container) that
+ * lacks some of them still reports the rest.  Counts for events that
+ * could not be opened are reported as negative values.
+ */
+
+typedef enum {
+    PC_CYCLES,
+    PC_INSTRUCTIONS,
+    PC_L1D_MISSES,
+    PC_LLC_MISSES,
+    PC_DTLB_MISSES,
+    PC_BRANCH_MISSES,
+    PC_NUM
+} perfctr_event_t;
+
+/* Short names of the events, for table headers */
+extern const char *perfctr_names[PC_NUM];
+
+/* Open the counters for the calling thread.  Returns number available */
+int perfctr_open(void);
+
+/* Close all open counters */
+void perfctr_close(void);
+
+/* Reset and start all open counters */
+void perfctr_start(void);
+
+/* Stop the counters and store the (multiplex-scaled) counts in counts.
+   Unavailable events are stored as -1 */
+void perfctr_stop(double counts[PC_NUM]);
+
+#endif /* __PERFCTR_H_ */
@@ -0,0 +1,86 @@
+/*
+ * replay.c - Standalone benchmark for a trace compiled by tracec
+ *
+ * Times the generated straight-line replay of one trace against mm.c
+ * with fcyc, or, with -n, just runs it the given number of times so
+ * that a profiler sees nothing but the allocator and the replay.
+ *
+ * Usage: <trace>.replay [-n <runs>] [-s <samples>] [-t]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "replay.h"
+#include "memlib.h"
+#include "fcyc.h"
+#include "clock.h"
+
+#define DEFAULT_SAMPLES 11
+
+/* One complete replay on a fresh heap */
+static void run_once(void *arg)
+{
+    (void) arg;
+    mem_reset_brk();
+    if (!mm_init()) {
+        fprintf(stderr, "mm_init failed\n");
+        exit(1);
+    }
+    replay_trace.run();
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n <runs>] [-s <samples>] [-t]\n", prog);
+    fprintf(stderr, "\t-n <runs>     Run <runs> times untimed (for profiling)\n");
+    fprintf(stderr, "\t-s <samples>  Take at least <samples> timing samples (default %d)\n",
+            DEFAULT_SAMPLES);
+    fprintf(stderr, "\t-t           Time with the calibrated time stamp counter\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    long runs = 0, samples = DEFAULT_SAMPLES, i;
+    int c;
+    fcyc_stats_t fs;
+
+    while ((c = getopt(argc, argv, "n:s:th")) != EOF) {
+        switch (c) {
+        case 'n':
+            runs = atol(optarg);
+            break;
+        case 's':
+            samples = atol(optarg);
+            break;
+        case 't':
+            if (!use_tsc_timer(1))
+                fprintf(stderr, "Warning: no stable invariant TSC; "
+                        "timing with the CPU-time clock\n");
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    mem_init();
+    if (runs > 0) {
+        for (i = 0; i < runs; i++)
+            run_once(NULL);
+        mem_deinit();
+        return 0;
+    }
+
+    set_fcyc_min_samples(samples);
+    fsec_stats(run_once, NULL, &fs);
+    printf("%s: %ld ops\n", replay_trace.name, replay_trace.ops);
+    printf("  median %.1f ns/op (95%% CI %.1f-%.1f), best %.1f ns/op\n",
+           fs.median / replay_trace.ops * 1e9, fs.ci_lo / replay_trace.ops * 1e9,
+           fs.ci_hi / replay_trace.ops * 1e9, fs.best / replay_trace.ops * 1e9);
+    printf("  median throughput %.0f Kops/sec over %ld samples%s\n",
+           replay_trace.ops / (fs.median * 1000.0), fs.nsamples,
+           fs.converged ? "" : " (K-best did not converge)");
+    mem_deinit();
+    return 0;
+}
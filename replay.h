@@ -0,0 +1,27 @@
+#ifndef __REPLAY_H_
+#define __REPLAY_H_
+
+/*
+ * replay.h - Interface between replay.c and the code tracec generates
+ *
+ * A generated file defines replay_trace, whose run function performs
+ * every request of one trace as a direct call into mm.c.  The heap
+ * must have been reset and mm_init called before each run.
+ */
+
+#include <stddef.h>
+
+#ifndef DRIVER
+#define DRIVER
+#endif
+#include "mm.h"
+
+typedef struct {
+    const char *name;     /* trace the code was generated from */
+    long ops;             /* number of requests */
+    void (*run)(void);    /* perform them all */
+} replay_t;
+
+extern const replay_t replay_trace;
+
+#endif /* __REPLAY_H_ */
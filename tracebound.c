@@ -0,0 +1,247 @@
+/*
+ * tracebound.c - Bound the heap any allocator needs for a trace
+ *
+ * The driver's utilization divides the peak payload by the heap size,
+ * but no aligned allocator can reach the peak payload: every block
+ * takes whole ALIGNMENT-byte granules, since two payloads never start
+ * in the same granule.  For each trace this prints
+ *
+ *   payload   the peak of live payload bytes (the driver's numerator)
+ *   bound     the peak of live bytes with each block rounded up to the
+ *             alignment (plus -o bytes of per-block overhead): a true
+ *             lower bound on the heap of any allocator of that kind
+ *   packed    the heap of an offline layout that knows every block's
+ *             lifetime in advance, placing blocks largest first at the
+ *             lowest address free for their whole lifetime
+ *
+ * The best possible heap lies between bound and packed.  An allocator
+ * whose heap is close to packed has little left to gain from
+ * fragmentation work on that trace; one far above it has.  Packed
+ * treats a realloc as a copy, so it overlaps the old and new block for
+ * that one request; bound treats it as an in-place resize.
+ *
+ * Usage: tracebound [-a <align>] [-o <overhead>] <trace>...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tracefile.h"
+
+#define DEFAULT_ALIGN 16
+
+/* A block's life at one size: live during requests [start, end) */
+typedef struct {
+    long start, end;
+    size_t size;            /* after rounding */
+    size_t offset;          /* where packing put it */
+    long next;              /* next placed interval by offset, or -1 */
+} interval_t;
+
+static size_t align = DEFAULT_ALIGN;
+static size_t overhead = 0;
+
+static size_t round_size(size_t size)
+{
+    return (size + overhead + align - 1) / align * align;
+}
+
+/*
+ * peaks - Peak live payload, and peak live rounded size with realloc
+ *     treated as an in-place resize
+ */
+static void peaks(const tf_trace_t *trace, size_t *payload, size_t *bound)
+{
+    size_t *cur = calloc(trace->num_ids + 1, sizeof(size_t));
+    char *live = calloc(trace->num_ids + 1, 1);
+    size_t live_payload = 0, live_bound = 0;
+    int i;
+
+    if (!cur || !live) {
+        fprintf(stderr, "Fatal error.  Out of memory bounding trace\n");
+        exit(1);
+    }
+    *payload = *bound = 0;
+    for (i = 0; i < trace->num_ops; i++) {
+        const tf_op_t *op = &trace->ops[i];
+        long id = op->index;
+
+        if (op->type == TF_FREE) {
+            if (id < 0 || !live[id])
+                continue;
+            live_payload -= cur[id];
+            live_bound -= round_size(cur[id]);
+            live[id] = 0;
+            cur[id] = 0;
+        } else {
+            if (live[id]) {
+                live_payload -= cur[id];
+                live_bound -= round_size(cur[id]);
+            }
+            live_payload += op->size;
+            live_bound += round_size(op->size);
+            live[id] = 1;
+            cur[id] = op->size;
+        }
+        if (live_payload > *payload)
+            *payload = live_payload;
+        if (live_bound > *bound)
+            *bound = live_bound;
+    }
+    free(cur);
+    free(live);
+}
+
+/* Lifetimes of every block at every size it had */
+static interval_t *intervals(const tf_trace_t *trace, long *count)
+{
+    interval_t *iv = malloc((trace->num_ops + 1) * sizeof(interval_t));
+    long *open = malloc((trace->num_ids + 1) * sizeof(long));
+    long n = 0, i;
+
+    if (!iv || !open) {
+        fprintf(stderr, "Fatal error.  Out of memory bounding trace\n");
+        exit(1);
+    }
+    for (i = 0; i < trace->num_ids; i++)
+        open[i] = -1;
+    for (i = 0; i < trace->num_ops; i++) {
+        const tf_op_t *op = &trace->ops[i];
+        long id = op->index;
+
+        if (id < 0)
+            continue;
+        if (open[id] >= 0) {
+            /* A realloc keeps the old block through its own request */
+            iv[open[id]].end = op->type == TF_REALLOC ? i + 1 : i;
+            open[id] = -1;
+        }
+        if (op->type != TF_FREE) {
+            iv[n].start = i;
+            iv[n].end = trace->num_ops;
+            iv[n].size = round_size(op->size);
+            open[id] = n++;
+        }
+    }
+    free(open);
+    *count = n;
+    return iv;
+}
+
+static int by_size(const void *a, const void *b)
+{
+    const interval_t *x = a, *y = b;
+    long xlen = x->end - x->start, ylen = y->end - y->start;
+
+    if (x->size != y->size)
+        return x->size < y->size ? 1 : -1;
+    if (xlen != ylen)
+        return xlen < ylen ? 1 : -1;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+/*
+ * pack - Place intervals largest first, each at the lowest offset that
+ *     is free for its whole lifetime, and return the heap size used.
+ *     Placed intervals are kept in a list ordered by offset, and the
+ *     search stops at the first gap big enough.
+ */
+static size_t pack(interval_t *iv, long n)
+{
+    long head = -1, i;
+    size_t heap = 0;
+
+    qsort(iv, n, sizeof(interval_t), by_size);
+    for (i = 0; i < n; i++) {
+        size_t offset = 0;
+        long p, prev = -1;
+
+        if (iv[i].size == 0)
+            continue;
+        for (p = head; p >= 0; p = iv[p].next) {
+            if (iv[p].offset <= offset)
+                prev = p;
+            if (iv[p].end <= iv[i].start || iv[p].start >= iv[i].end)
+                continue;
+            if (iv[p].offset >= offset + iv[i].size)
+                break;
+            if (iv[p].offset + iv[p].size > offset)
+                offset = iv[p].offset + iv[p].size;
+        }
+        /* offset may have moved past later blocks since prev was set */
+        p = prev < 0 ? head : iv[prev].next;
+        for (; p >= 0 && iv[p].offset <= offset; p = iv[p].next)
+            prev = p;
+        iv[i].offset = offset;
+        if (prev < 0) {
+            iv[i].next = head;
+            head = i;
+        } else {
+            iv[i].next = iv[prev].next;
+            iv[prev].next = i;
+        }
+        if (offset + iv[i].size > heap)
+            heap = offset + iv[i].size;
+    }
+    return heap;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-a <align>] [-o <overhead>] <trace>...\n", prog);
+    fprintf(stderr, "\t-a <align>     Payload alignment in bytes (default %d)\n",
+            DEFAULT_ALIGN);
+    fprintf(stderr, "\t-o <overhead>  Per-block overhead in bytes, e.g. 8 for a\n"
+                    "\t               header (default 0)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int c, i;
+    char err[256];
+
+    while ((c = getopt(argc, argv, "a:o:h")) != EOF) {
+        switch (c) {
+        case 'a':
+            align = strtoul(optarg, NULL, 0);
+            if (align == 0 || (align & (align - 1)) != 0) {
+                fprintf(stderr, "%s: alignment must be a power of two\n",
+                        argv[0]);
+                exit(1);
+            }
+            break;
+        case 'o':
+            overhead = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+
+    printf("%12s%12s%12s%9s%9s  %s\n", "payload", "bound", "packed",
+           "p/bound", "p/packed", "trace");
+    for (i = optind; i < argc; i++) {
+        tf_trace_t *trace = tf_read(argv[i], err, sizeof(err));
+        size_t payload, bound, packed;
+        interval_t *iv;
+        long n;
+
+        if (trace == NULL) {
+            fprintf(stderr, "%s: %s\n", argv[0], err);
+            exit(1);
+        }
+        peaks(trace, &payload, &bound);
+        iv = intervals(trace, &n);
+        packed = pack(iv, n);
+        printf("%12zu%12zu%12zu%8.1f%%%8.1f%%  %s\n", payload, bound, packed,
+               bound ? 100.0 * payload / bound : 0.0,
+               packed ? 100.0 * payload / packed : 0.0, argv[i]);
+        free(iv);
+        tf_free(trace);
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * tracec.c - Compile a trace file into straight-line replay code
+ *
+ * Reads a .rep (or binary) trace and writes a C file in which every
+ * request is a direct call, e.g.
+ *
+ *     p[17] = mm_malloc(48);
+ *     mm_free(p[3]);
+ *
+ * Linked with replay.o, mm.o and the timing support files, the result
+ * is a standalone benchmark that runs the allocator with none of the
+ * driver's interpretation overhead, and that perf can profile without
+ * driver noise.  The calls are split over functions of a few thousand
+ * requests each, which keeps compile times reasonable for long traces.
+ *
+ * Usage: tracec [-c <ops per function>] [-o <out.c>] <trace>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tracefile.h"
+
+#define DEFAULT_CHUNK 4096
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-c <ops per function>] [-o <out.c>] <trace>\n",
+            prog);
+    exit(1);
+}
+
+/* Write str with any characters that would end a C comment or string
+   replaced, so the file name can be quoted in the output */
+static void write_name(FILE *out, const char *str)
+{
+    for (; *str; str++)
+        fputc(*str == '"' || *str == '\\' || *str == '*' ? '_' : *str, out);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *out = stdout;
+    const char *outpath = NULL;
+    long chunk = DEFAULT_CHUNK;
+    long i, nchunks;
+    int c;
+    char err[256];
+    tf_trace_t *trace;
+
+    while ((c = getopt(argc, argv, "c:o:h")) != EOF) {
+        switch (c) {
+        case 'c':
+            chunk = atol(optarg);
+            if (chunk < 1)
+                chunk = 1;
+            break;
+        case 'o':
+            outpath = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    if ((trace = tf_read(argv[optind], err, sizeof(err))) == NULL) {
+        fprintf(stderr, "%s: %s\n", argv[0], err);
+        exit(1);
+    }
+    if (outpath && (out = fopen(outpath, "w")) == NULL) {
+        fprintf(stderr, "%s: could not create %s\n", argv[0], outpath);
+        exit(1);
+    }
+
+    fprintf(out, "/* Generated by tracec from ");
+    write_name(out, argv[optind]);
+    fprintf(out, ".  Do not edit. */\n");
+    fprintf(out, "#include \"replay.h\"\n\n");
+    fprintf(out, "static void *p[%d];\n", trace->num_ids > 0 ? trace->num_ids : 1);
+
+    for (i = 0; i < trace->num_ops; i++) {
+        const tf_op_t *op = &trace->ops[i];
+
+        if (i % chunk == 0)
+            fprintf(out, "%s\nstatic void chunk%ld(void)\n{\n",
+                    i ? "}\n" : "", i / chunk);
+        switch (op->type) {
+        case TF_ALLOC:
+            fprintf(out, "    p[%ld] = mm_malloc(%zu);\n", op->index, op->size);
+            break;
+        case TF_REALLOC:
+            fprintf(out, "    p[%ld] = mm_realloc(p[%ld], %zu);\n",
+                    op->index, op->index, op->size);
+            break;
+        case TF_FREE:
+            if (op->index < 0)
+                fprintf(out, "    mm_free(0);\n");
+            else
+                fprintf(out, "    mm_free(p[%ld]);\n", op->index);
+            break;
+        }
+    }
+
+    nchunks = (trace->num_ops + chunk - 1) / chunk;
+    fprintf(out, "%s\nstatic void run(void)\n{\n", nchunks ? "}\n" : "");
+    for (i = 0; i < nchunks; i++)
+        fprintf(out, "    chunk%ld();\n", i);
+    fprintf(out, "}\n\nconst replay_t replay_trace = {\n    \"");
+    write_name(out, argv[optind]);
+    fprintf(out, "\",\n    %d,\n    run\n};\n", trace->num_ops);
+    tf_free(trace);
+
+    if (outpath && fclose(out) != 0) {
+        fprintf(stderr, "%s: error writing %s\n", argv[0], outpath);
+        exit(1);
+    }
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * tracefile.c - Trace reader and writer for the offline trace tools
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "tracefile.h"
+
+typedef struct {
+    int32_t weight, num_ids, num_ops, reserved;
+    uint64_t data_bytes;
+} bin_header_t;
+
+typedef struct {
+    int32_t type;
+    int32_t index;
+    uint64_t size;
+} bin_op_t;
+
+static tf_trace_t *new_trace(int num_ops)
+{
+    tf_trace_t *trace = calloc(1, sizeof(tf_trace_t));
+    if (trace == NULL ||
+        (trace->ops = calloc(num_ops > 0 ? num_ops : 1, sizeof(tf_op_t))) == NULL) {
+        fprintf(stderr, "Fatal error.  Out of memory reading trace\n");
+        exit(1);
+    }
+    return trace;
+}
+
+/* Every block id must be in range; only free may take -1 (NULL) */
+static int check_trace(const tf_trace_t *trace, const char *path,
+                       char *err, size_t errlen)
+{
+    int i;
+    for (i = 0; i < trace->num_ops; i++) {
+        const tf_op_t *op = &trace->ops[i];
+        if (op->index >= trace->num_ids ||
+            (op->index < 0 && op->type != TF_FREE)) {
+            snprintf(err, errlen, "%s: request %d has bad block id %ld",
+                     path, i, op->index);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static tf_trace_t *read_binary(FILE *fp, const char *path,
+                               char *err, size_t errlen)
+{
+    bin_header_t hdr;
+    bin_op_t rec;
+    tf_trace_t *trace;
+    int i;
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.num_ops < 0 ||
+        hdr.num_ids < 0) {
+        snprintf(err, errlen, "%s: bad binary trace header", path);
+        return NULL;
+    }
+    trace = new_trace(hdr.num_ops);
+    trace->weight = hdr.weight;
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->data_bytes = hdr.data_bytes;
+    for (i = 0; i < trace->num_ops; i++) {
+        if (fread(&rec, sizeof(rec), 1, fp) != 1 ||
+            rec.type < TF_ALLOC || rec.type > TF_REALLOC) {
+            snprintf(err, errlen, "%s: bad or missing request %d", path, i);
+            tf_free(trace);
+            return NULL;
+        }
+        trace->ops[i].type = (tf_type_t) rec.type;
+        trace->ops[i].index = rec.index;
+        trace->ops[i].size = rec.size;
+    }
+    return trace;
+}
+
+static tf_trace_t *read_text(FILE *fp, const char *path,
+                             char *err, size_t errlen)
+{
+    int weight, num_ids, num_ops, i;
+    size_t data_bytes;
+    char type[16];
+    tf_trace_t *trace;
+
+    if (fscanf(fp, "%d %d %d %zu", &weight, &num_ids, &num_ops,
+               &data_bytes) != 4 || num_ids < 0 || num_ops < 0) {
+        snprintf(err, errlen, "%s: bad trace header", path);
+        return NULL;
+    }
+    trace = new_trace(num_ops);
+    trace->weight = weight;
+    trace->num_ids = num_ids;
+    trace->num_ops = num_ops;
+    trace->data_bytes = data_bytes;
+    for (i = 0; i < num_ops; i++) {
+        tf_op_t *op = &trace->ops[i];
+        int ok;
+
+        if (fscanf(fp, "%15s", type) != 1) {
+            snprintf(err, errlen, "%s: trace ends after %d of %d requests",
+                     path, i, num_ops);
+            tf_free(trace);
+            return NULL;
+        }
+        switch (type[0]) {
+        case 'a':
+            op->type = TF_ALLOC;
+            ok = fscanf(fp, "%ld %zu", &op->index, &op->size) == 2;
+            break;
+        case 'r':
+            op->type = TF_REALLOC;
+            ok = fscanf(fp, "%ld %zu", &op->index, &op->size) == 2;
+            break;
+        case 'f':
+            op->type = TF_FREE;
+            ok = fscanf(fp, "%ld", &op->index) == 1;
+            break;
+        default:
+            ok = 0;
+        }
+        if (!ok) {
+            snprintf(err, errlen, "%s: bad request %d", path, i);
+            tf_free(trace);
+            return NULL;
+        }
+    }
+    return trace;
+}
+
+tf_trace_t *tf_read(const char *path, char *err, size_t errlen)
+{
+    FILE *fp;
+    char magic[sizeof(TF_MAGIC) - 1];
+    tf_trace_t *trace;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        snprintf(err, errlen, "could not open %s", path);
+        return NULL;
+    }
+    if (fread(magic, sizeof(magic), 1, fp) == 1 &&
+        memcmp(magic, TF_MAGIC, sizeof(magic)) == 0) {
+        trace = read_binary(fp, path, err, errlen);
+    } else {
+        rewind(fp);
+        trace = read_text(fp, path, err, errlen);
+    }
+    fclose(fp);
+    if (trace && check_trace(trace, path, err, errlen) < 0) {
+        tf_free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+int tf_write_binary(const tf_trace_t *trace, const char *path)
+{
+    FILE *fp;
+    bin_header_t hdr;
+    bin_op_t rec;
+    int i;
+
+    if ((fp = fopen(path, "wb")) == NULL)
+        return -1;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.weight = trace->weight;
+    hdr.num_ids = trace->num_ids;
+    hdr.num_ops = trace->num_ops;
+    hdr.data_bytes = trace->data_bytes;
+    fwrite(TF_MAGIC, sizeof(TF_MAGIC) - 1, 1, fp);
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    memset(&rec, 0, sizeof(rec));
+    for (i = 0; i < trace->num_ops; i++) {
+        rec.type = trace->ops[i].type;
+        rec.index = (int32_t) trace->ops[i].index;
+        rec.size = trace->ops[i].size;
+        fwrite(&rec, sizeof(rec), 1, fp);
+    }
+    if (ferror(fp)) {
+        fclose(fp);
+        return -1;
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+int tf_write_text(const tf_trace_t *trace, const char *path)
+{
+    FILE *fp;
+    int i;
+
+    if ((fp = fopen(path, "w")) == NULL)
+        return -1;
+    fprintf(fp, "%d\n%d\n%d\n%zu\n", trace->weight, trace->num_ids,
+            trace->num_ops, trace->data_bytes);
+    for (i = 0; i < trace->num_ops; i++) {
+        const tf_op_t *op = &trace->ops[i];
+        switch (op->type) {
+        case TF_ALLOC:
+            fprintf(fp, "a %ld %zu\n", op->index, op->size);
+            break;
+        case TF_REALLOC:
+            fprintf(fp, "r %ld %zu\n", op->index, op->size);
+            break;
+        case TF_FREE:
+            fprintf(fp, "f %ld\n", op->index);
+            break;
+        }
+    }
+    if (ferror(fp)) {
+        fclose(fp);
+        return -1;
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+void tf_free(tf_trace_t *trace)
+{
+    if (trace == NULL)
+        return;
+    free(trace->ops);
+    free(trace);
+}
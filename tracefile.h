@@ -0,0 +1,51 @@
+#ifndef __TRACEFILE_H_
+#define __TRACEFILE_H_
+
+/*
+ * tracefile.h - Trace reader and writer for the offline trace tools
+ *
+ * Reads the driver's text .rep traces, and a binary form of the same
+ * thing that is quicker to load for long traces.  The driver keeps its
+ * own reader, which packs requests for replay; the tools want them
+ * plain.
+ *
+ * Binary traces, in host byte order:
+ *     char     magic[8]       TF_MAGIC
+ *     int32_t  weight, num_ids, num_ops, reserved
+ *     uint64_t data_bytes
+ *     num_ops records of { int32_t type; int32_t index; uint64_t size; }
+ */
+
+#include <stddef.h>
+
+#define TF_MAGIC "MMTRACE1"
+
+typedef enum { TF_ALLOC, TF_FREE, TF_REALLOC } tf_type_t;
+
+typedef struct {
+    tf_type_t type;
+    long index;             /* block id, or -1 for free(NULL) */
+    size_t size;            /* request size; 0 for frees */
+} tf_op_t;
+
+typedef struct {
+    int weight;
+    int num_ids;            /* number of distinct block ids */
+    int num_ops;            /* number of requests */
+    size_t data_bytes;      /* peak payload bytes, from the header */
+    tf_op_t *ops;
+} tf_trace_t;
+
+/* Read a text or binary trace.  Returns NULL and fills err on failure */
+tf_trace_t *tf_read(const char *path, char *err, size_t errlen);
+
+/* Write trace in binary form.  Returns 0, or -1 on error */
+int tf_write_binary(const tf_trace_t *trace, const char *path);
+
+/* Write trace as a text .rep file.  Returns 0, or -1 on error */
+int tf_write_text(const tf_trace_t *trace, const char *path);
+
+/* Free a trace returned by tf_read */
+void tf_free(tf_trace_t *trace);
+
+#endif /* __TRACEFILE_H_ */
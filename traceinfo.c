@@ -0,0 +1,519 @@
+/*
+ * traceinfo.c - Describe what a trace asks of an allocator
+ *
+ * For each trace (text .rep or binary) prints a summary of:
+ *   - request sizes, per power of two
+ *   - object lifetimes, in requests from malloc to free
+ *   - the live set over the trace
+ *   - realloc growth ratios
+ *   - free order: how often the block freed is the newest (LIFO) or
+ *     oldest (FIFO) of those live
+ *   - how requests would spread over mm.c's segregated free-list bins
+ * and optionally writes the same, with the full live-set curve, as JSON.
+ *
+ * The bin boundaries default to mm.c's (SIZE_1 .. SIZE_6, with block
+ * sizes computed the way mm_malloc does), but can be given with -b so
+ * that alternatives can be judged against real traces.
+ *
+ * Usage: traceinfo [-b <limits>] [-j <out.json>] [-p <points>]
+ *                  [-w <out.bin>] <trace>...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "tracefile.h"
+#include "json.h"
+
+#define SIZE_BUCKETS 65       /* size 0, then one per power of two */
+#define MAX_BINS 16
+#define DEFAULT_POINTS 100
+
+/* Block size for a request, as mm.c's mm_malloc computes it */
+#define HEADER_BYTES 8
+#define ALIGN_BYTES 16
+#define MIN_BLOCK 16
+
+/* Realloc growth ratio (new size / old size) classes */
+#define NUM_GROWTH 7
+static const char *growth_names[NUM_GROWTH] = {
+    "<0.5", "[0.5,1)", "1", "(1,1.5]", "(1.5,2]", "(2,4]", ">4"
+};
+
+typedef struct {
+    /* request counts */
+    long mallocs, reallocs, frees, null_frees;
+
+    /* request sizes per power of two: [2^(k-1), 2^k) in bucket k */
+    long size_count[SIZE_BUCKETS];
+    double size_bytes[SIZE_BUCKETS];
+
+    /* lifetimes, in requests, of blocks that were freed */
+    long *lifetimes;
+    long num_lifetimes;
+    long never_freed;
+    long life_count[SIZE_BUCKETS];
+
+    /* live set */
+    size_t peak_bytes;
+    long peak_blocks, peak_op;
+    int npoints;
+    size_t *curve_bytes;       /* live bytes after request curve_op[k] */
+    long *curve_blocks;
+    long *curve_op;
+
+    /* realloc growth */
+    long growth[NUM_GROWTH];
+    double growth_log_sum;     /* for the geometric mean */
+
+    /* free order */
+    long lifo, fifo, other, sole;
+    double rank_sum;           /* 0 = newest live block, 1 = oldest */
+
+    /* segregated list bins */
+    long bin_count[MAX_BINS];
+} info_t;
+
+static size_t bin_limit[MAX_BINS] = { 16, 32, 64, 128, 256, 512 };
+static int nbins = 7;          /* the last bin has no upper limit */
+
+/* Bucket k holds values in [2^(k-1), 2^k); bucket 0 holds 0 */
+static int pow2_bucket(size_t v)
+{
+    return v == 0 ? 0 : 64 - __builtin_clzll((unsigned long long) v);
+}
+
+static int size_to_bin(size_t size)
+{
+    size_t asize = (size + HEADER_BYTES + ALIGN_BYTES - 1) & ~(size_t) (ALIGN_BYTES - 1);
+    int i;
+
+    if (asize < MIN_BLOCK)
+        asize = MIN_BLOCK;
+    for (i = 0; i < nbins - 1; i++)
+        if (asize <= bin_limit[i])
+            return i;
+    return nbins - 1;
+}
+
+static int growth_class(size_t oldsize, size_t newsize)
+{
+    double r = (double) newsize / (double) oldsize;
+    if (r < 0.5) return 0;
+    if (r < 1.0) return 1;
+    if (r == 1.0) return 2;
+    if (r <= 1.5) return 3;
+    if (r <= 2.0) return 4;
+    if (r <= 4.0) return 5;
+    return 6;
+}
+
+/* Fenwick tree over request numbers, counting live blocks by birth */
+static void bit_add(long *bit, long n, long pos, long delta)
+{
+    for (pos++; pos <= n; pos += pos & -pos)
+        bit[pos] += delta;
+}
+
+static long bit_prefix(const long *bit, long pos)
+{
+    long sum = 0;
+    for (pos++; pos > 0; pos -= pos & -pos)
+        sum += bit[pos];
+    return sum;
+}
+
+static int compare_longs(const void *a, const void *b)
+{
+    long x = *(const long *) a, y = *(const long *) b;
+    return (x > y) - (x < y);
+}
+
+static long percentile(const long *sorted, long n, double pct)
+{
+    long k;
+    if (n == 0)
+        return 0;
+    k = (long) (pct / 100.0 * n);
+    return sorted[k < n ? k : n - 1];
+}
+
+static void analyze(const tf_trace_t *trace, info_t *info, int npoints)
+{
+    long n = trace->num_ops, i;
+    long *birth = malloc((trace->num_ids + 1) * sizeof(long));
+    size_t *cur = calloc(trace->num_ids + 1, sizeof(size_t));
+    long *bit = calloc(n + 1, sizeof(long));
+    size_t live_bytes = 0;
+    long live_blocks = 0;
+    int k = 0;
+
+    memset(info, 0, sizeof(*info));
+    info->lifetimes = malloc((n + 1) * sizeof(long));
+    info->npoints = npoints < n ? npoints : (int) n;
+    info->curve_bytes = calloc(info->npoints + 1, sizeof(size_t));
+    info->curve_blocks = calloc(info->npoints + 1, sizeof(long));
+    info->curve_op = calloc(info->npoints + 1, sizeof(long));
+    if (!birth || !cur || !bit || !info->lifetimes || !info->curve_bytes ||
+        !info->curve_blocks || !info->curve_op) {
+        fprintf(stderr, "Fatal error.  Out of memory analyzing trace\n");
+        exit(1);
+    }
+    for (i = 0; i < trace->num_ids; i++)
+        birth[i] = -1;
+
+    for (i = 0; i < n; i++) {
+        const tf_op_t *op = &trace->ops[i];
+        long id = op->index;
+
+        switch (op->type) {
+        case TF_ALLOC:
+            info->mallocs++;
+            info->size_count[pow2_bucket(op->size)]++;
+            info->size_bytes[pow2_bucket(op->size)] += op->size;
+            info->bin_count[size_to_bin(op->size)]++;
+            birth[id] = i;
+            cur[id] = op->size;
+            bit_add(bit, n, i, 1);
+            live_bytes += op->size;
+            live_blocks++;
+            break;
+
+        case TF_REALLOC:
+            info->reallocs++;
+            info->size_count[pow2_bucket(op->size)]++;
+            info->size_bytes[pow2_bucket(op->size)] += op->size;
+            info->bin_count[size_to_bin(op->size)]++;
+            if (birth[id] >= 0 && cur[id] > 0) {
+                info->growth[growth_class(cur[id], op->size)]++;
+                info->growth_log_sum += log((double) op->size / (double) cur[id]);
+            }
+            if (birth[id] < 0) {
+                /* realloc(NULL, size) acts as malloc */
+                birth[id] = i;
+                bit_add(bit, n, i, 1);
+                live_blocks++;
+            }
+            live_bytes += op->size - cur[id];
+            cur[id] = op->size;
+            break;
+
+        case TF_FREE:
+            info->frees++;
+            if (id < 0 || birth[id] < 0) {
+                info->null_frees++;
+                break;
+            } else {
+                long older = bit_prefix(bit, birth[id] - 1);
+                long newer = live_blocks - older - 1;
+                long life = i - birth[id];
+
+                if (older == 0 && newer == 0)
+                    info->sole++;
+                else if (newer == 0)
+                    info->lifo++;
+                else if (older == 0)
+                    info->fifo++;
+                else
+                    info->other++;
+                if (live_blocks > 1)
+                    info->rank_sum += (double) newer / (double) (live_blocks - 1);
+
+                info->lifetimes[info->num_lifetimes++] = life;
+                info->life_count[pow2_bucket(life)]++;
+                bit_add(bit, n, birth[id], -1);
+                live_bytes -= cur[id];
+                live_blocks--;
+                birth[id] = -1;
+                cur[id] = 0;
+            }
+            break;
+        }
+
+        if (live_bytes > info->peak_bytes) {
+            info->peak_bytes = live_bytes;
+            info->peak_op = i;
+        }
+        if (live_blocks > info->peak_blocks)
+            info->peak_blocks = live_blocks;
+        /* Sample the live set at evenly spaced requests, ending at the last */
+        if (k < info->npoints && (i + 1) * info->npoints >= (k + 1) * n) {
+            info->curve_bytes[k] = live_bytes;
+            info->curve_blocks[k] = live_blocks;
+            info->curve_op[k] = i;
+            k++;
+        }
+    }
+    for (i = 0; i < trace->num_ids; i++)
+        if (birth[i] >= 0)
+            info->never_freed++;
+    qsort(info->lifetimes, info->num_lifetimes, sizeof(long), compare_longs);
+
+    free(birth);
+    free(cur);
+    free(bit);
+}
+
+static void free_info(info_t *info)
+{
+    free(info->lifetimes);
+    free(info->curve_bytes);
+    free(info->curve_blocks);
+    free(info->curve_op);
+}
+
+static double pct(long part, long whole)
+{
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+/* Label of power-of-two bucket k, e.g. "[64,128)" */
+static void bucket_label(char *buf, size_t len, int k)
+{
+    if (k == 0)
+        snprintf(buf, len, "0");
+    else
+        snprintf(buf, len, "[%llu,%llu)", 1ULL << (k - 1),
+                 k < 64 ? 1ULL << k : 0ULL);
+}
+
+static void print_text(const char *path, const tf_trace_t *trace,
+                       const info_t *info)
+{
+    long requests = info->mallocs + info->reallocs;
+    long ordered = info->lifo + info->fifo + info->other;
+    char label[64];
+    int k;
+
+    printf("%s: %d requests on %d ids (weight %d)\n", path, trace->num_ops,
+           trace->num_ids, trace->weight);
+    printf("  malloc %ld, realloc %ld, free %ld (%ld of NULL)\n",
+           info->mallocs, info->reallocs, info->frees, info->null_frees);
+    printf("  peak live %zu bytes at request %ld, at most %ld blocks live; "
+           "%ld never freed\n", info->peak_bytes, info->peak_op,
+           info->peak_blocks, info->never_freed);
+
+    printf("\n  Request sizes:\n  %16s %9s %7s %12s\n", "bytes", "count", "%",
+           "total bytes");
+    for (k = 0; k < SIZE_BUCKETS; k++) {
+        if (info->size_count[k] == 0)
+            continue;
+        bucket_label(label, sizeof(label), k);
+        printf("  %16s %9ld %6.1f%% %12.0f\n", label, info->size_count[k],
+               pct(info->size_count[k], requests), info->size_bytes[k]);
+    }
+
+    printf("\n  Lifetimes (requests from malloc to free): p50 %ld, p90 %ld, "
+           "p99 %ld, max %ld\n",
+           percentile(info->lifetimes, info->num_lifetimes, 50),
+           percentile(info->lifetimes, info->num_lifetimes, 90),
+           percentile(info->lifetimes, info->num_lifetimes, 99),
+           info->num_lifetimes ? info->lifetimes[info->num_lifetimes - 1] : 0);
+    printf("  %16s %9s %7s\n", "requests", "count", "%");
+    for (k = 0; k < SIZE_BUCKETS; k++) {
+        if (info->life_count[k] == 0)
+            continue;
+        bucket_label(label, sizeof(label), k);
+        printf("  %16s %9ld %6.1f%%\n", label, info->life_count[k],
+               pct(info->life_count[k], info->num_lifetimes));
+    }
+
+    if (info->reallocs > 0) {
+        long grown = 0;
+        for (k = 0; k < NUM_GROWTH; k++)
+            grown += info->growth[k];
+        printf("\n  Realloc growth (new/old size), geometric mean %.2f:\n",
+               grown ? exp(info->growth_log_sum / grown) : 0.0);
+        for (k = 0; k < NUM_GROWTH; k++)
+            if (info->growth[k])
+                printf("  %16s %9ld %6.1f%%\n", growth_names[k],
+                       info->growth[k], pct(info->growth[k], grown));
+    }
+
+    printf("\n  Free order: LIFO %.1f%%, FIFO %.1f%%, other %.1f%% "
+           "(mean age rank %.2f, 0 = newest); %ld frees of the only live block\n",
+           pct(info->lifo, ordered), pct(info->fifo, ordered),
+           pct(info->other, ordered),
+           ordered ? info->rank_sum / ordered : 0.0, info->sole);
+
+    printf("\n  Free-list bins (block size = request + %d, rounded to %d):\n",
+           HEADER_BYTES, ALIGN_BYTES);
+    for (k = 0; k < nbins; k++) {
+        if (k < nbins - 1)
+            snprintf(label, sizeof(label), "<= %zu", bin_limit[k]);
+        else
+            snprintf(label, sizeof(label), "> %zu", bin_limit[nbins - 2]);
+        printf("  %16s %9ld %6.1f%%\n", label, info->bin_count[k],
+               pct(info->bin_count[k], requests));
+    }
+    printf("\n");
+}
+
+static void write_json(FILE *fp, const char *path, const tf_trace_t *trace,
+                       const info_t *info)
+{
+    long grown = 0;
+    int k, first;
+
+    fprintf(fp, "  {\"trace\": ");
+    json_write_string(fp, path);
+    fprintf(fp, ", \"ops\": %d, \"ids\": %d, \"weight\": %d,\n", trace->num_ops,
+            trace->num_ids, trace->weight);
+    fprintf(fp, "   \"malloc\": %ld, \"realloc\": %ld, \"free\": %ld, "
+            "\"free_null\": %ld,\n", info->mallocs, info->reallocs, info->frees,
+            info->null_frees);
+    fprintf(fp, "   \"peak_live_bytes\": %zu, \"peak_op\": %ld, "
+            "\"peak_live_blocks\": %ld, \"never_freed\": %ld,\n",
+            info->peak_bytes, info->peak_op, info->peak_blocks,
+            info->never_freed);
+
+    /* Power-of-two histograms, keyed by the bucket's lower bound */
+    fprintf(fp, "   \"sizes\": [");
+    for (k = 0, first = 1; k < SIZE_BUCKETS; k++) {
+        if (info->size_count[k] == 0)
+            continue;
+        fprintf(fp, "%s{\"min\": %llu, \"count\": %ld, \"bytes\": %.0f}",
+                first ? "" : ", ", k ? 1ULL << (k - 1) : 0ULL,
+                info->size_count[k], info->size_bytes[k]);
+        first = 0;
+    }
+    fprintf(fp, "],\n   \"lifetimes\": {\"p50\": %ld, \"p90\": %ld, "
+            "\"p99\": %ld, \"max\": %ld, \"histogram\": [",
+            percentile(info->lifetimes, info->num_lifetimes, 50),
+            percentile(info->lifetimes, info->num_lifetimes, 90),
+            percentile(info->lifetimes, info->num_lifetimes, 99),
+            info->num_lifetimes ? info->lifetimes[info->num_lifetimes - 1] : 0);
+    for (k = 0, first = 1; k < SIZE_BUCKETS; k++) {
+        if (info->life_count[k] == 0)
+            continue;
+        fprintf(fp, "%s{\"min\": %llu, \"count\": %ld}", first ? "" : ", ",
+                k ? 1ULL << (k - 1) : 0ULL, info->life_count[k]);
+        first = 0;
+    }
+
+    fprintf(fp, "]},\n   \"live\": [");
+    for (k = 0; k < info->npoints; k++)
+        fprintf(fp, "%s[%ld, %zu, %ld]", k ? ", " : "", info->curve_op[k],
+                info->curve_bytes[k], info->curve_blocks[k]);
+
+    for (k = 0; k < NUM_GROWTH; k++)
+        grown += info->growth[k];
+    fprintf(fp, "],\n   \"realloc_growth\": {\"geomean\": %.4g",
+            grown ? exp(info->growth_log_sum / grown) : 0.0);
+    for (k = 0; k < NUM_GROWTH; k++)
+        fprintf(fp, ", \"%s\": %ld", growth_names[k], info->growth[k]);
+
+    fprintf(fp, "},\n   \"free_order\": {\"lifo\": %ld, \"fifo\": %ld, "
+            "\"other\": %ld, \"sole\": %ld, \"mean_rank\": %.4g},\n",
+            info->lifo, info->fifo, info->other, info->sole,
+            info->lifo + info->fifo + info->other ?
+            info->rank_sum / (info->lifo + info->fifo + info->other) : 0.0);
+
+    fprintf(fp, "   \"bins\": [");
+    for (k = 0; k < nbins; k++)
+        fprintf(fp, "%s{\"limit\": %zu, \"count\": %ld}", k ? ", " : "",
+                k < nbins - 1 ? bin_limit[k] : 0, info->bin_count[k]);
+    fprintf(fp, "]}");
+}
+
+/* Parse a comma-separated, increasing list of bin limits */
+static void parse_bins(const char *arg)
+{
+    char *copy = strdup(arg), *tok, *save = NULL;
+    int n = 0;
+
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (n == MAX_BINS - 1) {
+            fprintf(stderr, "At most %d bin limits\n", MAX_BINS - 1);
+            exit(1);
+        }
+        bin_limit[n] = strtoul(tok, NULL, 0);
+        if (n > 0 && bin_limit[n] <= bin_limit[n - 1]) {
+            fprintf(stderr, "Bin limits must increase\n");
+            exit(1);
+        }
+        n++;
+    }
+    free(copy);
+    nbins = n + 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-b <limits>] [-j <out.json>] [-p <points>] "
+            "[-w <out.bin>] <trace>...\n", prog);
+    fprintf(stderr, "\t-b <limits>    Free-list bin limits, e.g. 16,32,64 "
+            "(default mm.c's)\n");
+    fprintf(stderr, "\t-j <file>      Also write the results as JSON\n");
+    fprintf(stderr, "\t-p <points>    Live-set samples in the JSON (default %d)\n",
+            DEFAULT_POINTS);
+    fprintf(stderr, "\t-w <file>      Write the (single) trace in binary form\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *json_path = NULL, *bin_path = NULL;
+    int npoints = DEFAULT_POINTS, c, i;
+    FILE *jfp = NULL;
+    char err[256];
+
+    while ((c = getopt(argc, argv, "b:j:p:w:h")) != EOF) {
+        switch (c) {
+        case 'b':
+            parse_bins(optarg);
+            break;
+        case 'j':
+            json_path = optarg;
+            break;
+        case 'p':
+            npoints = atoi(optarg);
+            if (npoints < 1)
+                npoints = 1;
+            break;
+        case 'w':
+            bin_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc || (bin_path && optind != argc - 1))
+        usage(argv[0]);
+
+    if (json_path) {
+        if ((jfp = fopen(json_path, "w")) == NULL) {
+            fprintf(stderr, "%s: could not create %s\n", argv[0], json_path);
+            exit(1);
+        }
+        fprintf(jfp, "[\n");
+    }
+    for (i = optind; i < argc; i++) {
+        tf_trace_t *trace = tf_read(argv[i], err, sizeof(err));
+        info_t info;
+
+        if (trace == NULL) {
+            fprintf(stderr, "%s: %s\n", argv[0], err);
+            exit(1);
+        }
+        analyze(trace, &info, npoints);
+        print_text(argv[i], trace, &info);
+        if (jfp) {
+            write_json(jfp, argv[i], trace, &info);
+            fprintf(jfp, i < argc - 1 ? ",\n" : "\n");
+        }
+        if (bin_path && tf_write_binary(trace, bin_path) < 0) {
+            fprintf(stderr, "%s: could not write %s\n", argv[0], bin_path);
+            exit(1);
+        }
+        free_info(&info);
+        tf_free(trace);
+    }
+    if (jfp) {
+        fprintf(jfp, "]\n");
+        fclose(jfp);
+    }
+    return 0;
+}